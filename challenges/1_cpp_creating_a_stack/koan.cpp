@@ -10,40 +10,175 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iostream>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 /// BEGIN EDIT ------------------------------------------------------
 
 //
 
-template <typename T>
+template <typename T, std::size_t N = 0, typename Allocator = std::allocator<T>>
 
 /**
- * @brief A generic stack implementation using a vector as the underlying container.
+ * @brief A generic stack implementation with room for N elements inline.
  *
  * This class provides standard stack operations such as push, pop, and access
  * to the top element. The stack follows a last-in-first-out (LIFO) order.
+ * The first N elements live inside the object itself, and only deeper
+ * elements spill over into a vector, so a stack that never grows past N
+ * never allocates. With the default N of 0 every element goes to the vector.
+ *
+ * The vector draws its memory from Allocator, which follows the usual rules
+ * for standard containers when stacks are copied, moved or swapped. With
+ * pmr::Stack many short-lived stacks can share an arena that is released in
+ * one go. Inline elements are built with T's own constructors.
  *
  * @tparam T The type of elements stored in the stack.
+ * @tparam N The number of elements stored inline.
+ * @tparam Allocator The allocator for elements beyond the first N.
  */
 class Stack {
 
 public:
+    using allocator_type = Allocator;
+
     /**
      * @brief Default builder to define an empty stack.
      */
     Stack() = default;
 
     /**
-     * @brief Push an element at the end of the container elements_,
-     * which is a vector.
+     * @brief Define an empty stack that allocates from the given allocator.
+     *
+     * @param allocator The allocator for spilled elements.
+     */
+    explicit Stack(const Allocator& allocator) : spill_(allocator) {}
+
+    /**
+     * @brief Copy every element of another stack, keeping their order.
+     *
+     * The allocator is obtained through
+     * `select_on_container_copy_construction()`, as for standard containers.
+     *
+     * @param other The stack to copy.
+     */
+    Stack(const Stack& other) : spill_(other.spill_) {
+        copy_inline_from(other);
+    }
+
+    /**
+     * @brief Copy every element of another stack into one that uses the
+     * given allocator.
+     *
+     * @param other The stack to copy.
+     * @param allocator The allocator for spilled elements.
+     */
+    Stack(const Stack& other, const Allocator& allocator) : spill_(other.spill_, allocator) {
+        copy_inline_from(other);
+    }
+
+    /**
+     * @brief Take over the elements of another stack, which is left empty.
+     *
+     * Inline elements are moved one by one; spilled ones keep their buffer.
+     *
+     * @param other The stack to move from.
+     */
+    Stack(Stack&& other) noexcept(std::is_nothrow_move_constructible<T>::value)
+        : spill_(std::move(other.spill_)) {
+        move_inline_from(other);
+        other.clear();
+    }
+
+    /**
+     * @brief Move the elements of another stack into one that uses the given
+     * allocator. Spilled elements are moved one by one unless both
+     * allocators are equal.
+     *
+     * @param other The stack to move from.
+     * @param allocator The allocator for spilled elements.
+     */
+    Stack(Stack&& other, const Allocator& allocator) : spill_(std::move(other.spill_), allocator) {
+        move_inline_from(other);
+        other.clear();
+    }
+
+    /**
+     * @brief Replace the contents with a copy of another stack.
+     *
+     * The allocator is replaced only if it propagates on copy assignment.
+     *
+     * @param other The stack to copy.
+     * @return This stack.
+     */
+    Stack& operator=(const Stack& other) {
+        if (this != &other) {
+            // Inline elements first: elements may only spill once the
+            // inline slots are full, even if a copy throws half way
+            clear();
+            copy_inline_from(other);
+            spill_ = other.spill_;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Replace the contents with the elements of another stack, which
+     * is left empty.
+     *
+     * The allocator is replaced only if it propagates on move assignment;
+     * otherwise spilled elements are moved one by one unless both
+     * allocators are equal.
+     *
+     * @param other The stack to move from.
+     * @return This stack.
+     */
+    Stack& operator=(Stack&& other) noexcept(std::is_nothrow_move_constructible<T>::value &&
+                                             kMovesBuffers) {
+        if (this != &other) {
+            clear();
+            move_inline_from(other);
+            spill_ = std::move(other.spill_);
+            other.clear();
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Destroy the remaining elements.
+     */
+    ~Stack() {
+        clear_inline();
+    }
+
+    /**
+     * @brief Push an element on top of the stack, inline while there is
+     * room and into the vector afterwards.
      *
      * @param value The value to be pushed onto the stack.
      */
     void push(const T& value) {
-        elements_.push_back(value);
+        if (inline_size_ < N) {
+            emplace_inline(value);
+        } else {
+            spill_.push_back(value);
+        }
     }
 
     /**
@@ -52,7 +187,11 @@ public:
      * @param value The value to be pushed onto the stack (rvalue reference).
      */
     void push(T&& value) {
-        elements_.push_back(std::move(value));
+        if (inline_size_ < N) {
+            emplace_inline(std::move(value));
+        } else {
+            spill_.push_back(std::move(value));
+        }
     }
 
     /**
@@ -63,10 +202,13 @@ public:
      * @throws std::out_of_range If the stack is empty.
      */
     void pop() {
-        if (elements_.empty()) {
+        if (!spill_.empty()) {
+            spill_.pop_back();
+        } else if (inline_size_ > 0) {
+            inline_at(--inline_size_).~T();
+        } else {
             throw std::out_of_range("Stack is empty");
         }
-        elements_.pop_back();
     }
 
     /**
@@ -76,10 +218,13 @@ public:
      * @throws std::out_of_range If the stack is empty.
      */
     T& top() {
-        if (elements_.empty()) {
+        if (!spill_.empty()) {
+            return spill_.back();
+        }
+        if (inline_size_ == 0) {
             throw std::out_of_range("Stack is empty");
         }
-        return elements_.back();
+        return inline_at(inline_size_ - 1);
     }
 
     /**
@@ -89,10 +234,257 @@ public:
      * @throws std::out_of_range If the stack is empty.
      */
     const T& top() const {
-        if (elements_.empty()) {
+        return const_cast<Stack&>(*this).top();
+    }
+
+    /**
+     * @brief Check if the stack is empty.
+     *
+     * @return `true` if the stack is empty, otherwise `false`.
+     */
+    bool empty() const {
+        // Elements only spill once the inline slots are full
+        return inline_size_ == 0 && spill_.empty();
+    }
+
+    /**
+     * @brief Number of elements in the stack.
+     *
+     * @return The element count, inline and spilled.
+     */
+    std::size_t size() const {
+        return inline_size_ + spill_.size();
+    }
+
+    /**
+     * @brief The allocator used for spilled elements.
+     *
+     * @return A copy of the allocator.
+     */
+    Allocator get_allocator() const {
+        return spill_.get_allocator();
+    }
+
+private:
+    /**
+     * @brief Whether move assignment can always hand the vector buffer over
+     * instead of moving its elements into a buffer of our own.
+     */
+    static constexpr bool kMovesBuffers =
+        std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+        std::allocator_traits<Allocator>::is_always_equal::value;
+
+    template <typename U>
+    void emplace_inline(U&& value) {
+        new (&inline_[inline_size_]) T(std::forward<U>(value));
+        ++inline_size_;
+    }
+
+    T& inline_at(std::size_t index) {
+        return *std::launder(reinterpret_cast<T*>(&inline_[index]));
+    }
+
+    const T& inline_at(std::size_t index) const {
+        return *std::launder(reinterpret_cast<const T*>(&inline_[index]));
+    }
+
+    // The destructor does not run for a half-built stack, so both of these
+    // destroy the elements they already made before passing an error on
+    void copy_inline_from(const Stack& other) {
+        try {
+            for (std::size_t i = 0; i < other.inline_size_; ++i) {
+                emplace_inline(other.inline_at(i));
+            }
+        } catch (...) {
+            clear_inline();
+            throw;
+        }
+    }
+
+    void move_inline_from(Stack& other) {
+        try {
+            for (std::size_t i = 0; i < other.inline_size_; ++i) {
+                emplace_inline(std::move(other.inline_at(i)));
+            }
+        } catch (...) {
+            clear_inline();
+            throw;
+        }
+    }
+
+    void clear_inline() {
+        while (inline_size_ > 0) {
+            inline_at(--inline_size_).~T();
+        }
+    }
+
+    void clear() {
+        spill_.clear();
+        clear_inline();
+    }
+
+    /**
+     * @brief Raw storage for the first N elements; the first inline_size_
+     * slots hold live objects.
+     */
+    std::array<std::aligned_storage_t<sizeof(T), alignof(T)>, N> inline_;
+    std::size_t inline_size_{0};
+
+    /**
+     * @brief Container for the elements beyond the first N.
+     */
+    std::vector<T, Allocator> spill_;
+};
+
+namespace pmr {
+
+/**
+ * @brief Stack whose spilled elements come from a `std::pmr::memory_resource`.
+ */
+template <typename T, std::size_t N = 0>
+using Stack = ::Stack<T, N, std::pmr::polymorphic_allocator<T>>;
+
+} // namespace pmr
+
+//
+
+template <typename T, std::size_t ChunkSize = 64>
+
+/**
+ * @brief A stack that stores its elements in a linked list of fixed-size
+ * chunks instead of one growing vector.
+ *
+ * Growing never moves existing elements: a full chunk is simply followed by
+ * a new one. Every push is O(1) in the worst case, and a reference returned
+ * by top() stays valid until that element is popped. A chunk is released as
+ * soon as it empties, except for one spare that is kept back so that pushing
+ * and popping across a chunk boundary does not allocate every time.
+ *
+ * @tparam T The type of elements stored in the stack.
+ * @tparam ChunkSize The number of elements per chunk.
+ */
+class SegmentedStack {
+    static_assert(ChunkSize > 0, "chunks must hold at least one element");
+
+public:
+    /**
+     * @brief Default builder to define an empty stack.
+     */
+    SegmentedStack() = default;
+
+    /**
+     * @brief Copy every element of another stack, keeping their order.
+     *
+     * @param other The stack to copy.
+     */
+    SegmentedStack(const SegmentedStack& other) {
+        std::vector<const Chunk*> chunks;
+        for (const Chunk* chunk = other.top_; chunk != nullptr; chunk = chunk->below) {
+            chunks.push_back(chunk);
+        }
+        try {
+            for (auto it = chunks.crbegin(); it != chunks.crend(); ++it) {
+                const auto count = *it == other.top_ ? other.top_count_ : ChunkSize;
+                for (std::size_t i = 0; i < count; ++i) {
+                    push((*it)->at(i));
+                }
+            }
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    /**
+     * @brief Take over the chunks of another stack, which is left empty.
+     *
+     * @param other The stack to move from.
+     */
+    SegmentedStack(SegmentedStack&& other) noexcept {
+        swap(other);
+    }
+
+    /**
+     * @brief Replace the contents with those of another stack, copied or
+     * moved into the parameter.
+     *
+     * @param other The new contents.
+     * @return This stack.
+     */
+    SegmentedStack& operator=(SegmentedStack other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    /**
+     * @brief Destroy the remaining elements and free every chunk.
+     */
+    ~SegmentedStack() {
+        release();
+    }
+
+    /**
+     * @brief Push an element onto the stack, starting a new chunk (the spare
+     * if there is one) when the top one is full.
+     *
+     * @param value The value to be pushed onto the stack.
+     */
+    void push(const T& value) {
+        emplace(value);
+    }
+
+    /**
+     * @brief Push an element directly in case of not belong to a var.
+     *
+     * @param value The value to be pushed onto the stack (rvalue reference).
+     */
+    void push(T&& value) {
+        emplace(std::move(value));
+    }
+
+    /**
+     * @brief Remove the top element from the stack.
+     *
+     * A chunk left empty becomes the spare, and the previous spare is freed.
+     *
+     * @throws std::out_of_range If the stack is empty.
+     */
+    void pop() {
+        if (top_count_ == 0) {
+            throw std::out_of_range("Stack is empty");
+        }
+        top_->at(--top_count_).~T();
+        --size_;
+        if (top_count_ == 0) {
+            Chunk* emptied = top_;
+            top_ = emptied->below;
+            top_count_ = top_ != nullptr ? ChunkSize : 0;
+            delete spare_;
+            spare_ = emptied;
+        }
+    }
+
+    /**
+     * @brief Access the top element of the stack.
+     *
+     * @return A reference to the top element, valid until it is popped.
+     * @throws std::out_of_range If the stack is empty.
+     */
+    T& top() {
+        if (top_count_ == 0) {
             throw std::out_of_range("Stack is empty");
         }
-        return elements_.back();
+        return top_->at(top_count_ - 1);
+    }
+
+    /**
+     * @brief Access the top element of the stack (const).
+     *
+     * @return A const reference to the top element.
+     * @throws std::out_of_range If the stack is empty.
+     */
+    const T& top() const {
+        return const_cast<SegmentedStack&>(*this).top();
     }
 
     /**
@@ -101,14 +493,388 @@ public:
      * @return `true` if the stack is empty, otherwise `false`.
      */
     bool empty() const {
-        return elements_.empty();
+        return size_ == 0;
+    }
+
+    /**
+     * @brief Number of elements in the stack.
+     *
+     * @return The element count.
+     */
+    std::size_t size() const {
+        return size_;
+    }
+
+    /**
+     * @brief Number of chunks currently allocated, including the spare.
+     *
+     * @return The chunk count.
+     */
+    std::size_t chunk_count() const {
+        return (size_ + ChunkSize - 1) / ChunkSize + (spare_ != nullptr ? 1 : 0);
+    }
+
+    /**
+     * @brief Exchange the contents of two stacks without touching any
+     * element.
+     *
+     * @param other The stack to swap with.
+     */
+    void swap(SegmentedStack& other) noexcept {
+        std::swap(top_, other.top_);
+        std::swap(top_count_, other.top_count_);
+        std::swap(size_, other.size_);
+        std::swap(spare_, other.spare_);
     }
 
 private:
+    struct Chunk {
+        explicit Chunk(Chunk* chunk_below) : below(chunk_below) {}
+
+        T& at(std::size_t index) {
+            return *std::launder(reinterpret_cast<T*>(&storage[index]));
+        }
+
+        const T& at(std::size_t index) const {
+            return *std::launder(reinterpret_cast<const T*>(&storage[index]));
+        }
+
+        std::array<std::aligned_storage_t<sizeof(T), alignof(T)>, ChunkSize> storage;
+        Chunk* below;
+    };
+
+    template <typename U>
+    void emplace(U&& value) {
+        if (top_ != nullptr && top_count_ < ChunkSize) {
+            new (&top_->storage[top_count_]) T(std::forward<U>(value));
+            ++top_count_;
+        } else {
+            // The new chunk is only linked in once its first element exists,
+            // so a throwing constructor leaves the stack as it was
+            Chunk* chunk = spare_ != nullptr ? spare_ : new Chunk(nullptr);
+            try {
+                new (&chunk->storage[0]) T(std::forward<U>(value));
+            } catch (...) {
+                spare_ = chunk;
+                throw;
+            }
+            spare_ = nullptr;
+            chunk->below = top_;
+            top_ = chunk;
+            top_count_ = 1;
+        }
+        ++size_;
+    }
+
+    void release() {
+        while (top_ != nullptr) {
+            for (std::size_t i = top_count_; i > 0; --i) {
+                top_->at(i - 1).~T();
+            }
+            Chunk* below = top_->below;
+            delete top_;
+            top_ = below;
+            top_count_ = ChunkSize;
+        }
+        top_count_ = 0;
+        size_ = 0;
+        delete spare_;
+        spare_ = nullptr;
+    }
+
+    /**
+     * @brief Chunk holding the top element; each chunk links to the one
+     * below it.
+     */
+    Chunk* top_ = nullptr;
+
+    /**
+     * @brief Elements in the top chunk; every chunk below it is full.
+     */
+    std::size_t top_count_ = 0;
+    std::size_t size_ = 0;
+
     /**
-     * @brief Container to store stack elements.
+     * @brief An empty chunk kept for the next push past a chunk boundary.
      */
-    std::vector<T> elements_;
+    Chunk* spare_ = nullptr;
+};
+
+template <typename T>
+
+/**
+ * @brief A lock-free stack that many threads can push to and pop from.
+ *
+ * Elements live in a singly linked list whose head is swapped with
+ * compare-and-swap (Treiber's stack). A popping thread announces the node it
+ * is about to read in a hazard pointer, and popped nodes are only deleted
+ * once no hazard pointer refers to them. A node address therefore cannot be
+ * reused while a thread may still compare against it, which also rules out
+ * the ABA problem. There is no top(): another thread could pop the element
+ * between top() and pop(), so try_pop() does both in one step.
+ *
+ * Pushes are always lock-free. A pop needs one of 64 hazard slots for its
+ * duration, so pops are lock-free for up to 64 concurrent poppers; a
+ * further popper spins until one of them finishes.
+ *
+ * @tparam T The type of elements stored in the stack.
+ */
+class ConcurrentStack {
+
+public:
+    /**
+     * @brief Default builder to define an empty stack.
+     */
+    ConcurrentStack() = default;
+
+    ConcurrentStack(const ConcurrentStack&) = delete;
+    ConcurrentStack& operator=(const ConcurrentStack&) = delete;
+
+    /**
+     * @brief Destroy the remaining and the retired elements. No other thread
+     * may still be using the stack.
+     */
+    ~ConcurrentStack() {
+        delete_list(head_.load(std::memory_order_relaxed), &Node::next);
+        delete_list(retired_.load(std::memory_order_relaxed), &Node::retired_next);
+    }
+
+    /**
+     * @brief Push a copy of an element onto the stack.
+     *
+     * @param value The value to be pushed onto the stack.
+     */
+    void push(const T& value) {
+        link(new Node(value));
+    }
+
+    /**
+     * @brief Push an element directly in case of not belong to a var.
+     *
+     * @param value The value to be pushed onto the stack (rvalue reference).
+     */
+    void push(T&& value) {
+        link(new Node(std::move(value)));
+    }
+
+    /**
+     * @brief Remove the top element and hand it to the caller.
+     *
+     * @return The former top element, or `std::nullopt` if the stack was
+     * empty.
+     */
+    std::optional<T> try_pop() {
+        Node* node = nullptr;
+        {
+            HazardPointer hazard(*this);
+            node = head_.load(std::memory_order_acquire);
+            do {
+                // The announcement only counts once head_ still points at the
+                // node afterwards; before that it may already be retired
+                Node* announced = nullptr;
+                do {
+                    announced = node;
+                    hazard.protect(announced);
+                    node = head_.load(std::memory_order_seq_cst);
+                } while (node != announced);
+                if (node == nullptr) {
+                    return std::nullopt;
+                }
+                // Sequentially consistent, like the announcement: a thread
+                // that announced this node either sees it unlinked here or
+                // has its hazard pointer seen by reclaim()
+            } while (!head_.compare_exchange_strong(node, node->next, std::memory_order_seq_cst,
+                                                    std::memory_order_acquire));
+        }
+        // Retired even if moving the value out throws, since the node is
+        // already unlinked and nobody else would free it
+        struct RetireOnExit {
+            ConcurrentStack* stack;
+            Node* node;
+            ~RetireOnExit() {
+                stack->retire(node);
+            }
+        } retire_on_exit{this, node};
+        return std::optional<T>(std::move(node->value));
+    }
+
+    /**
+     * @brief Remove the top element from the stack.
+     *
+     * @throws std::out_of_range If the stack is empty.
+     */
+    void pop() {
+        if (!try_pop()) {
+            throw std::out_of_range("Stack is empty");
+        }
+    }
+
+    /**
+     * @brief Check if the stack is empty.
+     *
+     * The answer may already be out of date when it is returned if other
+     * threads use the stack at the same time.
+     *
+     * @return `true` if the stack is empty, otherwise `false`.
+     */
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        template <typename U>
+        explicit Node(U&& element) : value(std::forward<U>(element)) {}
+
+        T value;
+        Node* next = nullptr;
+        // Separate from next, which a thread that lost the race for this
+        // node may still read after it has been retired
+        Node* retired_next = nullptr;
+    };
+
+    /**
+     * @brief One slot per thread in a pop; more concurrent poppers than
+     * slots wait for a free one.
+     */
+    static constexpr std::size_t kHazardSlots = 64;
+
+    /**
+     * @brief Retired nodes gathered before a reclamation pass; a multiple of
+     * the slot count, so every pass frees at least half of them.
+     */
+    static constexpr std::size_t kReclaimThreshold = 2 * kHazardSlots;
+
+    struct alignas(64) HazardSlot {
+        std::atomic<bool> owned{false};
+        std::atomic<Node*> pointer{nullptr};
+    };
+
+    /**
+     * @brief Claims a hazard slot for the duration of one pop.
+     */
+    class HazardPointer {
+    public:
+        explicit HazardPointer(ConcurrentStack& stack) {
+            // Threads start their search at different slots so that they do
+            // not all fight over the first one
+            static thread_local const std::size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+            for (std::size_t attempt = 0;; ++attempt) {
+                auto& slot = stack.hazards_[(start + attempt) % kHazardSlots];
+                if (!slot.owned.load(std::memory_order_relaxed) &&
+                    !slot.owned.exchange(true, std::memory_order_acquire)) {
+                    slot_ = &slot;
+                    return;
+                }
+                if (attempt % kHazardSlots == kHazardSlots - 1) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        HazardPointer(const HazardPointer&) = delete;
+        HazardPointer& operator=(const HazardPointer&) = delete;
+
+        ~HazardPointer() {
+            slot_->pointer.store(nullptr, std::memory_order_release);
+            slot_->owned.store(false, std::memory_order_release);
+        }
+
+        void protect(Node* node) {
+            slot_->pointer.store(node, std::memory_order_seq_cst);
+        }
+
+    private:
+        HazardSlot* slot_ = nullptr;
+    };
+
+    void link(Node* node) {
+        node->next = head_.load(std::memory_order_relaxed);
+        while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+        }
+    }
+
+    void retire(Node* node) noexcept {
+        push_retired(node, node);
+        if (retired_count_.fetch_add(1, std::memory_order_relaxed) + 1 >= kReclaimThreshold) {
+            reclaim();
+        }
+    }
+
+    void push_retired(Node* first, Node* last) noexcept {
+        last->retired_next = retired_.load(std::memory_order_relaxed);
+        while (!retired_.compare_exchange_weak(last->retired_next, first, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * @brief Delete every retired node that no hazard pointer refers to, and
+     * put the others back on the retired list.
+     */
+    void reclaim() noexcept {
+        Node* node = retired_.exchange(nullptr, std::memory_order_acquire);
+        if (node == nullptr) {
+            return;
+        }
+        // A fixed array rather than a vector: reclaim() runs while try_pop()
+        // unwinds and must not be able to throw
+        std::array<Node*, kHazardSlots> hazard_pointers{};
+        std::size_t hazard_count = 0;
+        for (const auto& slot : hazards_) {
+            if (Node* pointer = slot.pointer.load(std::memory_order_seq_cst)) {
+                hazard_pointers[hazard_count++] = pointer;
+            }
+        }
+        const auto hazards_end = hazard_pointers.begin() + hazard_count;
+        std::sort(hazard_pointers.begin(), hazards_end);
+
+        Node* kept_first = nullptr;
+        Node* kept_last = nullptr;
+        std::size_t freed = 0;
+        std::size_t kept = 0;
+        while (node != nullptr) {
+            Node* next = node->retired_next;
+            if (std::binary_search(hazard_pointers.begin(), hazards_end, node)) {
+                node->retired_next = kept_first;
+                kept_first = node;
+                if (kept_last == nullptr) {
+                    kept_last = node;
+                }
+                ++kept;
+            } else {
+                delete node;
+                ++freed;
+            }
+            node = next;
+        }
+        retired_count_.fetch_sub(freed, std::memory_order_relaxed);
+        if (kept_first != nullptr) {
+            push_retired(kept_first, kept_last);
+        }
+    }
+
+    static void delete_list(Node* node, Node* Node::*link) {
+        while (node != nullptr) {
+            Node* next = node->*link;
+            delete node;
+            node = next;
+        }
+    }
+
+    /**
+     * @brief Top of the stack, or null when it is empty.
+     */
+    std::atomic<Node*> head_{nullptr};
+
+    /**
+     * @brief Popped nodes waiting until no thread can still be reading them.
+     */
+    std::atomic<Node*> retired_{nullptr};
+    std::atomic<std::size_t> retired_count_{0};
+
+    std::array<HazardSlot, kHazardSlots> hazards_;
 };
 
 //
@@ -209,6 +975,107 @@ TYPED_TEST(WhatAreYouMadeOf, StackOrdering) {
   ASSERT_TRUE(const_uut.empty());
 }
 
+TYPED_TEST(WhatAreYouMadeOf, SpillsPastInlineCapacity) {
+  // test that a stack with inline capacity keeps the same ordering when it
+  // grows past that capacity and shrinks back, and that copies and moves
+  // carry every element along
+  using T = TypeParam;
+  const auto v1 = Values<T>::first_value();
+  const auto v2 = Values<T>::second_value();
+
+  Stack<T, 4> uut;
+  static_assert(sizeof(uut) >= 4 * sizeof(T), "the first elements live inline");
+
+  // asymmetric sequence, three times the inline capacity
+  const auto test_data =
+      std::vector<T>{v1, v2, v2, v1, v2, v2, v2, v1, v2, v2, v2, v2};
+
+  for (auto it = test_data.cbegin(); it != test_data.cend(); ++it) {
+    uut.push(*it);
+    ASSERT_EQ(*it, uut.top());
+  }
+  ASSERT_EQ(test_data.size(), uut.size());
+
+  Stack<T, 4> copy(uut);
+  Stack<T, 4> moved(std::move(copy));
+  ASSERT_TRUE(copy.empty());
+  Stack<T, 4> assigned;
+  assigned.push(v2);
+  assigned = moved;
+
+  for (auto it = test_data.crbegin(); it != test_data.crend(); ++it) {
+    ASSERT_FALSE(uut.empty());
+    ASSERT_EQ(*it, uut.top());
+    ASSERT_EQ(*it, moved.top());
+    ASSERT_EQ(*it, assigned.top());
+    uut.pop();
+    moved.pop();
+    assigned.pop();
+  }
+
+  ASSERT_TRUE(uut.empty());
+  ASSERT_TRUE(moved.empty());
+  ASSERT_TRUE(assigned.empty());
+  ASSERT_THROW(uut.pop(), std::out_of_range);
+  ASSERT_THROW(uut.top(), std::out_of_range);
+}
+
+TYPED_TEST(WhatAreYouMadeOf, SegmentedStorage) {
+  // test that chunked storage keeps the stack ordering across chunk
+  // boundaries, that references to elements survive later pushes, and that
+  // chunks are given back as the stack shrinks
+  using T = TypeParam;
+  const auto v1 = Values<T>::first_value();
+  const auto v2 = Values<T>::second_value();
+
+  SegmentedStack<T, 4> uut;
+  const auto &const_uut = uut;
+  ASSERT_TRUE(uut.empty());
+  ASSERT_EQ(0, uut.chunk_count());
+
+  // asymmetric sequence, three chunks long
+  const auto test_data =
+      std::vector<T>{v1, v2, v2, v1, v2, v2, v2, v1, v2, v2, v2, v2};
+
+  uut.push(test_data.front());
+  const T *bottom = &uut.top();
+  for (auto it = test_data.cbegin() + 1; it != test_data.cend(); ++it) {
+    uut.push(*it);
+    ASSERT_EQ(*it, const_uut.top());
+  }
+  ASSERT_EQ(test_data.front(), *bottom);
+  ASSERT_EQ(3, uut.chunk_count());
+
+  SegmentedStack<T, 4> copy(uut);
+  SegmentedStack<T, 4> moved(std::move(copy));
+  ASSERT_TRUE(copy.empty());
+
+  for (auto it = test_data.crbegin(); it != test_data.crend(); ++it) {
+    ASSERT_EQ(*it, uut.top());
+    ASSERT_EQ(*it, moved.top());
+    uut.pop();
+    moved.pop();
+  }
+  ASSERT_TRUE(uut.empty());
+  // only the spare chunk is left
+  ASSERT_EQ(1, uut.chunk_count());
+  ASSERT_THROW(uut.pop(), std::out_of_range);
+  ASSERT_THROW(const_uut.top(), std::out_of_range);
+
+  // pushing and popping across a boundary reuses the spare
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 5; ++i) {
+      uut.push(v1);
+    }
+    ASSERT_EQ(2, uut.chunk_count());
+    uut.pop();
+    ASSERT_EQ(2, uut.chunk_count());
+    for (int i = 0; i < 4; ++i) {
+      uut.pop();
+    }
+  }
+}
+
 TEST(WhatAreYouMadeOfFixedType, CanYouAcceptMoveOnlyData) {
   // test that the stack supports move-only data types
   using ContentT = std::string;
@@ -246,6 +1113,359 @@ TEST(WhatAreYouMadeOfFixedType, CanYouAcceptMoveOnlyData) {
   ASSERT_TRUE(const_uut.empty());
 }
 
+TEST(WhatAreYouMadeOfFixedType, CanYouKeepMoveOnlyDataInline) {
+  // test that move-only data works in the inline slots, past them, and when
+  // the whole stack is moved
+  using ContentT = std::string;
+  using MoveOnlyT = std::unique_ptr<ContentT>;
+  const auto v1 = Values<ContentT>::first_value();
+  const auto v2 = Values<ContentT>::second_value();
+
+  Stack<MoveOnlyT, 3> uut;
+
+  const auto test_data = std::vector<ContentT>{v1, v2, v2, v1, v2, v1};
+
+  for (auto it = test_data.cbegin(); it != test_data.cend(); ++it) {
+    uut.push(std::make_unique<ContentT>(*it));
+    ASSERT_EQ(*it, *uut.top());
+  }
+
+  Stack<MoveOnlyT, 3> moved;
+  moved = std::move(uut);
+  ASSERT_TRUE(uut.empty());
+
+  for (auto it = test_data.crbegin(); it != test_data.crend(); ++it) {
+    ASSERT_FALSE(moved.empty());
+    ASSERT_EQ(*it, *moved.top());
+    moved.pop();
+  }
+
+  ASSERT_TRUE(moved.empty());
+}
+
+/**
+ * @brief Memory resource that counts the allocations it passes on.
+ */
+class CountingResource : public std::pmr::memory_resource {
+public:
+  std::size_t allocations = 0;
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    ++allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *pointer, std::size_t bytes,
+                     std::size_t alignment) override {
+    std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+  }
+
+  bool
+  do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+TEST(WhatAreYouMadeOfFixedType, CanYouUseAMemoryResource) {
+  // test that a pmr stack takes its memory from the resource it was given,
+  // and that copies and moves treat the resource like standard containers:
+  // copies start on the default resource, assignment keeps the target's
+  CountingResource arena;
+  CountingResource other_arena;
+  const auto v1 = Values<std::string>::first_value();
+
+  pmr::Stack<std::string, 2> uut(&arena);
+  for (int i = 0; i < 10; ++i) {
+    uut.push(v1);
+  }
+  ASSERT_GT(arena.allocations, 0);
+  ASSERT_EQ(&arena, uut.get_allocator().resource());
+
+  const pmr::Stack<std::string, 2> copy(uut);
+  ASSERT_EQ(std::pmr::get_default_resource(), copy.get_allocator().resource());
+  const pmr::Stack<std::string, 2> arena_copy(uut, &other_arena);
+  ASSERT_EQ(&other_arena, arena_copy.get_allocator().resource());
+  ASSERT_EQ(10, arena_copy.size());
+
+  pmr::Stack<std::string, 2> assigned(&other_arena);
+  assigned = uut;
+  ASSERT_EQ(&other_arena, assigned.get_allocator().resource());
+  ASSERT_EQ(10, assigned.size());
+
+  // moving between resources moves the elements into the target's memory
+  const auto allocations = other_arena.allocations;
+  pmr::Stack<std::string, 2> moved(&other_arena);
+  moved = std::move(uut);
+  ASSERT_TRUE(uut.empty());
+  ASSERT_EQ(&other_arena, moved.get_allocator().resource());
+  ASSERT_GT(other_arena.allocations, allocations);
+  ASSERT_EQ(10, moved.size());
+
+  // a move within one resource hands the buffer over
+  const auto before_move = other_arena.allocations;
+  pmr::Stack<std::string, 2> taken(std::move(moved));
+  ASSERT_EQ(before_move, other_arena.allocations);
+  while (!taken.empty()) {
+    ASSERT_EQ(v1, taken.top());
+    taken.pop();
+  }
+}
+
+TEST(WhatAreYouMadeOfFixedType, CanYouSegmentMoveOnlyData) {
+  // test that chunked storage accepts move-only data and that assignment
+  // moves the whole stack
+  using ContentT = std::string;
+  using MoveOnlyT = std::unique_ptr<ContentT>;
+  const auto v1 = Values<ContentT>::first_value();
+  const auto v2 = Values<ContentT>::second_value();
+
+  SegmentedStack<MoveOnlyT, 2> uut;
+
+  const auto test_data = std::vector<ContentT>{v1, v2, v2, v1, v2};
+  for (auto it = test_data.cbegin(); it != test_data.cend(); ++it) {
+    uut.push(std::make_unique<ContentT>(*it));
+    ASSERT_EQ(*it, *uut.top());
+  }
+
+  SegmentedStack<MoveOnlyT, 2> moved;
+  moved = std::move(uut);
+  ASSERT_TRUE(uut.empty());
+
+  for (auto it = test_data.crbegin(); it != test_data.crend(); ++it) {
+    ASSERT_EQ(*it, *moved.top());
+    moved.pop();
+  }
+  ASSERT_TRUE(moved.empty());
+}
+
+TEST(SharedAcrossThreads, ConcurrentStackOrdering) {
+  // test that, used from a single thread, the concurrent stack behaves like
+  // Stack, and that try_pop() hands move-only data over to the caller
+  using ContentT = std::string;
+  using MoveOnlyT = std::unique_ptr<ContentT>;
+  const auto v1 = Values<ContentT>::first_value();
+  const auto v2 = Values<ContentT>::second_value();
+
+  ConcurrentStack<MoveOnlyT> uut;
+  ASSERT_TRUE(uut.empty());
+  ASSERT_FALSE(uut.try_pop());
+  ASSERT_THROW(uut.pop(), std::out_of_range);
+
+  const auto test_data = std::vector<ContentT>{v1, v2, v2, v1, v2, v2, v2, v1};
+  for (auto it = test_data.cbegin(); it != test_data.cend(); ++it) {
+    uut.push(std::make_unique<ContentT>(*it));
+    ASSERT_FALSE(uut.empty());
+  }
+  for (auto it = test_data.crbegin(); it != test_data.crend(); ++it) {
+    auto popped = uut.try_pop();
+    ASSERT_TRUE(popped);
+    ASSERT_EQ(*it, **popped);
+  }
+  ASSERT_TRUE(uut.empty());
+}
+
+TEST(SharedAcrossThreads, FailedPopFreesTheNode) {
+  // test that an element whose move throws while being popped is still
+  // removed and its node freed (the leak checker of a sanitizer build
+  // reports it otherwise), and that the stack stays usable
+  struct FragileMove {
+    explicit FragileMove(bool *fail) : fail_on_move(fail) {}
+    FragileMove(FragileMove &&other) : fail_on_move(other.fail_on_move) {
+      if (*fail_on_move) {
+        throw std::runtime_error("move failed");
+      }
+    }
+    bool *fail_on_move;
+  };
+
+  bool fail = false;
+  ConcurrentStack<FragileMove> uut;
+  uut.push(FragileMove(&fail));
+  uut.push(FragileMove(&fail));
+  fail = true;
+  ASSERT_THROW(uut.try_pop(), std::runtime_error);
+  fail = false;
+  ASSERT_TRUE(uut.try_pop());
+  ASSERT_TRUE(uut.empty());
+}
+
+TEST(SharedAcrossThreads, EveryElementIsPoppedOnce) {
+  // test that concurrent pushes and pops neither lose nor duplicate
+  // elements; enough of them are popped to run many reclamation passes
+  constexpr std::size_t kThreads = 4;
+  constexpr std::size_t kPerThread = 20000;
+  ConcurrentStack<std::unique_ptr<std::size_t>> uut;
+  std::vector<std::atomic<int>> seen(kThreads * kPerThread);
+
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (std::size_t i = 0; i < kPerThread; ++i) {
+        uut.push(std::make_unique<std::size_t>(t * kPerThread + i));
+        // pop about as often as we push, so the stack stays short and
+        // threads keep racing for the same head
+        if (i % 2 == 1) {
+          while (true) {
+            if (auto popped = uut.try_pop()) {
+              ++seen[**popped];
+              break;
+            }
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  while (auto popped = uut.try_pop()) {
+    ++seen[**popped];
+  }
+  for (const auto &count : seen) {
+    ASSERT_EQ(1, count.load());
+  }
+}
+
+// Benchmarks follow. They are disabled to keep the regular test run fast;
+// run them with --gtest_also_run_disabled_tests --gtest_filter='*Benchmark*'.
+
+TEST(WhatAreYouMadeOfFixedType, DISABLED_BenchmarkPushLatency) {
+  // compares the slowest single push of a vector-backed Stack, which now
+  // and then reallocates, with chunked storage
+  constexpr std::size_t kPushes = 4000000;
+  const auto slowest_push = [](auto &stack) {
+    double slowest = 0;
+    for (std::size_t i = 0; i < kPushes; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      stack.push(i);
+      slowest = std::max(slowest, std::chrono::duration<double, std::micro>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count());
+    }
+    return slowest;
+  };
+
+  Stack<std::size_t> vector_backed;
+  SegmentedStack<std::size_t, 1024> segmented;
+  const auto vector_us = slowest_push(vector_backed);
+  const auto segmented_us = slowest_push(segmented);
+  std::cout << kPushes << " pushes, slowest push: vector " << vector_us
+            << " us, segmented " << segmented_us << " us" << std::endl;
+}
+
+TEST(WhatAreYouMadeOfFixedType, DISABLED_BenchmarkArenaStacks) {
+  // compares thousands of small short-lived stacks on the default allocator
+  // with the same stacks on a per-request arena that is released all at once
+  constexpr std::size_t kRequests = 200;
+  constexpr std::size_t kStacksPerRequest = 5000;
+  constexpr std::size_t kDepth = 24;
+  const auto time = [](auto &&body) {
+    const auto start = std::chrono::steady_clock::now();
+    body();
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+
+  const auto default_ms = time([&] {
+    for (std::size_t request = 0; request < kRequests; ++request) {
+      std::vector<Stack<std::size_t>> stacks(kStacksPerRequest);
+      for (auto &stack : stacks) {
+        for (std::size_t i = 0; i < kDepth; ++i) {
+          stack.push(i);
+        }
+      }
+    }
+  });
+
+  std::vector<std::byte> buffer(1 << 22);
+  const auto arena_ms = time([&] {
+    for (std::size_t request = 0; request < kRequests; ++request) {
+      std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+      std::pmr::vector<pmr::Stack<std::size_t>> stacks(kStacksPerRequest,
+                                                       &arena);
+      for (auto &stack : stacks) {
+        for (std::size_t i = 0; i < kDepth; ++i) {
+          stack.push(i);
+        }
+      }
+    }
+  });
+
+  std::pmr::unsynchronized_pool_resource pool;
+  const auto pool_ms = time([&] {
+    for (std::size_t request = 0; request < kRequests; ++request) {
+      std::pmr::vector<pmr::Stack<std::size_t>> stacks(kStacksPerRequest,
+                                                       &pool);
+      for (auto &stack : stacks) {
+        for (std::size_t i = 0; i < kDepth; ++i) {
+          stack.push(i);
+        }
+      }
+    }
+  });
+
+  std::cout << kRequests << " requests x " << kStacksPerRequest
+            << " stacks: default allocator " << default_ms
+            << " ms, monotonic arena " << arena_ms << " ms, pool " << pool_ms
+            << " ms" << std::endl;
+}
+
+TEST(SharedAcrossThreads, DISABLED_BenchmarkContention) {
+  // compares the lock-free stack with a Stack guarded by a mutex, each
+  // thread pushing and popping in turn
+  constexpr std::size_t kOperations = 1000000;
+  const auto max_threads =
+      std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+  const auto run = [](std::size_t thread_count, auto &&push, auto &&pop) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < thread_count; ++t) {
+      threads.emplace_back([&] {
+        for (std::size_t i = 0; i < kOperations / thread_count; ++i) {
+          push(i);
+          pop();
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+
+  for (std::size_t thread_count = 1; thread_count <= max_threads;
+       thread_count *= 2) {
+    ConcurrentStack<std::size_t> lock_free;
+    const auto lock_free_ms = run(
+        thread_count, [&](std::size_t value) { lock_free.push(value); },
+        [&] { lock_free.try_pop(); });
+
+    Stack<std::size_t> guarded;
+    std::mutex mutex;
+    const auto mutex_ms = run(
+        thread_count,
+        [&](std::size_t value) {
+          std::lock_guard<std::mutex> lock(mutex);
+          guarded.push(value);
+        },
+        [&] {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!guarded.empty()) {
+            guarded.pop();
+          }
+        });
+
+    std::cout << thread_count << " threads, " << kOperations
+              << " push/pop pairs: lock-free " << lock_free_ms << " ms, mutex "
+              << mutex_ms << " ms" << std::endl;
+  }
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
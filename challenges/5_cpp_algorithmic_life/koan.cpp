@@ -20,132 +20,3758 @@
 //   the correct order.
 
 #include <algorithm>
-#include <memory>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <limits>
 #include <queue>
-#include <set>
+#include <random>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KOAN_HAS_MMAP 1
+#endif
 #include "gtest/gtest.h"
 
-/// BEGIN EDIT ------------------------------------------------------
+/// BEGIN EDIT ------------------------------------------------------
+
+// Fixed set of worker threads running parallel loops. The calling thread
+// takes part in every loop as worker 0, so a pool of size 1 starts no threads
+// at all and runs everything inline.
+class ThreadPool {
+public:
+  explicit ThreadPool(std::size_t thread_count = std::thread::hardware_concurrency()) {
+    thread_count = std::max<std::size_t>(thread_count, 1);
+    for (std::size_t worker = 1; worker < thread_count; ++worker) {
+      threads_.emplace_back([this, worker] { work(worker); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) thread.join();
+  }
+
+  // Number of workers, counting the calling thread.
+  std::size_t size() const { return threads_.size() + 1; }
+
+  // Calls task(index, worker) for every index in [0, count) spread over the
+  // workers, and returns once all calls have finished. worker is below
+  // size(), so it can select per-thread scratch state. The first exception
+  // thrown by a task is rethrown here after the loop drains.
+  template <typename Task>
+  void parallel_for(std::size_t count, Task&& task) {
+    if (count == 0) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = [&task](std::size_t index, std::size_t worker) { task(index, worker); };
+      count_ = count;
+      next_.store(0);
+      busy_ = threads_.size();
+      error_ = nullptr;
+      ++round_;
+    }
+    wake_.notify_all();
+    run_tasks(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return busy_ == 0; });
+    task_ = nullptr;
+    if (error_) std::rethrow_exception(error_);
+  }
+
+private:
+  void work(std::size_t worker) {
+    std::size_t seen_round = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&] { return stopping_ || round_ != seen_round; });
+        if (stopping_) return;
+        seen_round = round_;
+      }
+      run_tasks(worker);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--busy_ == 0) done_.notify_one();
+    }
+  }
+
+  void run_tasks(std::size_t worker) {
+    for (auto index = next_.fetch_add(1); index < count_; index = next_.fetch_add(1)) {
+      try {
+        task_(index, worker);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) error_ = std::current_exception();
+      }
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::function<void(std::size_t, std::size_t)> task_;
+  std::size_t count_{0};
+  std::atomic<std::size_t> next_{0};
+  std::size_t busy_{0};      // Threads still working on the current round
+  std::size_t round_{0};     // Incremented for every parallel_for
+  bool stopping_{false};
+  std::exception_ptr error_;
+};
+
+// Bounded multi-producer multi-consumer queue after Dmitry Vyukov's design.
+// Every cell carries a sequence number telling producers and consumers whose
+// turn it is, so a push or pop claims its position with one compare-exchange
+// and never takes a lock. The capacity is rounded up to a power of two.
+template <typename T>
+class BoundedMpmcQueue {
+public:
+  explicit BoundedMpmcQueue(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) size *= 2;
+    cells_.reset(new Cell[size]);
+    mask_ = size - 1;
+    for (std::size_t position = 0; position < size; ++position) {
+      cells_[position].sequence.store(position, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+  BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
+
+  std::size_t capacity() const { return mask_ + 1; }
+
+  // Moves value in and returns true, or leaves it untouched and returns
+  // false when the queue is full.
+  bool try_push(T& value) {
+    auto position = enqueue_.load(std::memory_order_relaxed);
+    while (true) {
+      auto& cell = cells_[position & mask_];
+      const auto sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+      if (lag == 0) {
+        if (enqueue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        return false; // The cell still holds the item from one lap ago
+      } else {
+        position = enqueue_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Moves the oldest item into value, or returns false when the queue is
+  // empty (including while its next item is still being written).
+  bool try_pop(T& value) {
+    auto position = dequeue_.load(std::memory_order_relaxed);
+    while (true) {
+      auto& cell = cells_[position & mask_];
+      const auto sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto lag = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+      if (lag == 0) {
+        if (dequeue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          value = std::move(cell.value);
+          cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        return false;
+      } else {
+        position = dequeue_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  struct alignas(64) Cell {
+    std::atomic<std::size_t> sequence{0};
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  std::size_t mask_{0};
+  // Producers and consumers each hammer their own counter; keep them on
+  // separate cache lines
+  alignas(64) std::atomic<std::size_t> enqueue_{0};
+  alignas(64) std::atomic<std::size_t> dequeue_{0};
+};
+
+// What one query did, as recorded by a workspace with the QueryStats policy.
+struct QueryCounters {
+  std::uint64_t settled{0};       // Vertices whose distance became final
+  std::uint64_t pushes{0};        // Queue insertions
+  std::uint64_t stale_pops{0};    // Queue entries skipped because their vertex was already settled
+  std::uint64_t edges_relaxed{0}; // Edges scanned out of settled vertices
+  std::chrono::nanoseconds search_time{0};
+  std::chrono::nanoseconds trace_time{0}; // Path reconstruction
+
+  QueryCounters& operator+=(const QueryCounters& other) {
+    settled += other.settled;
+    pushes += other.pushes;
+    stale_pops += other.stale_pops;
+    edges_relaxed += other.edges_relaxed;
+    search_time += other.search_time;
+    trace_time += other.trace_time;
+    return *this;
+  }
+};
+
+// Stats policies of a query workspace. The searches report every event to
+// the policy; NoQueryStats, the default, ignores them at no cost, and
+// QueryStats counts them for the current query.
+class NoQueryStats {
+public:
+  static constexpr bool kEnabled = false;
+
+  void clear() {}
+  void pushed() {}
+  void settled() {}
+  void stale_pop() {}
+  void relaxed() {}
+};
+
+class QueryStats {
+public:
+  static constexpr bool kEnabled = true;
+
+  const QueryCounters& counters() const { return counters_; }
+
+  void clear() { counters_ = QueryCounters{}; }
+  void pushed() { ++counters_.pushes; }
+  void settled() { ++counters_.settled; }
+  void stale_pop() { ++counters_.stale_pops; }
+  void relaxed() { ++counters_.edges_relaxed; }
+  void add_time(std::chrono::nanoseconds QueryCounters::*phase, std::chrono::nanoseconds elapsed) {
+    counters_.*phase += elapsed;
+  }
+
+private:
+  QueryCounters counters_;
+};
+
+// Running totals over many queries. Workspaces add each finished query with
+// relaxed atomic increments, so one instance can be shared by every thread;
+// reading it while queries run gives approximate figures.
+class AggregateQueryStats {
+public:
+  void add(const QueryCounters& counters) {
+    queries_.fetch_add(1, std::memory_order_relaxed);
+    settled_.fetch_add(counters.settled, std::memory_order_relaxed);
+    pushes_.fetch_add(counters.pushes, std::memory_order_relaxed);
+    stale_pops_.fetch_add(counters.stale_pops, std::memory_order_relaxed);
+    edges_relaxed_.fetch_add(counters.edges_relaxed, std::memory_order_relaxed);
+    search_ns_.fetch_add(counters.search_time.count(), std::memory_order_relaxed);
+    trace_ns_.fetch_add(counters.trace_time.count(), std::memory_order_relaxed);
+    auto worst = max_settled_.load(std::memory_order_relaxed);
+    while (counters.settled > worst &&
+           !max_settled_.compare_exchange_weak(worst, counters.settled, std::memory_order_relaxed)) {
+    }
+  }
+
+  std::uint64_t queries() const { return queries_.load(std::memory_order_relaxed); }
+
+  // Settled vertices of the most expensive single query, to spot
+  // pathological inputs.
+  std::uint64_t max_settled() const { return max_settled_.load(std::memory_order_relaxed); }
+
+  QueryCounters totals() const {
+    QueryCounters totals;
+    totals.settled = settled_.load(std::memory_order_relaxed);
+    totals.pushes = pushes_.load(std::memory_order_relaxed);
+    totals.stale_pops = stale_pops_.load(std::memory_order_relaxed);
+    totals.edges_relaxed = edges_relaxed_.load(std::memory_order_relaxed);
+    totals.search_time = std::chrono::nanoseconds(search_ns_.load(std::memory_order_relaxed));
+    totals.trace_time = std::chrono::nanoseconds(trace_ns_.load(std::memory_order_relaxed));
+    return totals;
+  }
+
+private:
+  std::atomic<std::uint64_t> queries_{0};
+  std::atomic<std::uint64_t> settled_{0};
+  std::atomic<std::uint64_t> pushes_{0};
+  std::atomic<std::uint64_t> stale_pops_{0};
+  std::atomic<std::uint64_t> edges_relaxed_{0};
+  std::atomic<std::int64_t> search_ns_{0};
+  std::atomic<std::int64_t> trace_ns_{0};
+  std::atomic<std::uint64_t> max_settled_{0};
+};
+
+template <typename Graph, typename Id, typename Cost>
+class ShortestPathQueries;
+
+template <typename Id, typename Cost>
+class BasicContractionHierarchy;
+
+// Types shared by every graph layout, so a Snapshot can copy the calculator's
+// edge records verbatim and one workspace can serve queries on either. Id is
+// the unsigned integer type of vertex and edge ids, Cost any arithmetic type
+// for non-negative edge costs; 32-bit types halve the size of an edge record.
+template <typename Id, typename Cost>
+class BasicShortestPathTypes {
+public:
+  static_assert(std::is_integral_v<Id> && std::is_unsigned_v<Id>, "Ids must be unsigned integers");
+  static_assert(std::is_arithmetic_v<Cost>, "Costs must be arithmetic");
+
+  using id_type = Id;     // Alias for node/edge IDs.
+  using cost_type = Cost; // Alias for edge costs.
+  using index_type = Id;  // Alias for dense vertex indices; there are never more vertices than ids.
+
+  static constexpr cost_type kUnreachable = std::numeric_limits<cost_type>::has_infinity
+                                                ? std::numeric_limits<cost_type>::infinity()
+                                                : std::numeric_limits<cost_type>::max();
+  static constexpr id_type kNoEdge = std::numeric_limits<id_type>::max();
+
+  // Upper bound on the bucket arrays of the bucket-based algorithms.
+  static constexpr std::size_t kMaxBucketCount = std::size_t{1} << 24;
+
+  // Path cost accumulation. Integer sums saturate at kUnreachable instead of
+  // wrapping around to a small cost; floating point sums reach infinity.
+  static constexpr cost_type add_costs(cost_type a, cost_type b) {
+    if constexpr (std::is_integral_v<cost_type>) {
+      return b >= kUnreachable - a ? kUnreachable : static_cast<cost_type>(a + b);
+    } else {
+      return a + b;
+    }
+  }
+
+  // Edge costs must be non-negative for the searches to be exact; floating
+  // point costs must also be finite.
+  static bool valid_cost(cost_type cost) {
+    if constexpr (std::is_floating_point_v<cost_type>) {
+      return cost >= 0 && cost < kUnreachable;
+    } else if constexpr (std::is_signed_v<cost_type>) {
+      return cost >= 0;
+    } else {
+      return true;
+    }
+  }
+
+  using PriorityQueueItem = std::pair<cost_type, index_type>; // Priority queue item: {cost, vertex index}.
+
+  // Queue policies for the search loops. Each one holds {key, vertex} entries
+  // and provides
+  //   void reset(std::size_t vertex_count, cost_type max_edge_cost);
+  //   void push(cost_type key, index_type vertex);
+  //   PriorityQueueItem pop();   // an entry with the smallest key
+  //   cost_type min_key();       // kUnreachable when empty
+  //   bool empty() const;
+  // Queues may keep outdated entries of a vertex around (lazy deletion); the
+  // searches skip those when they pop for an already settled vertex.
+
+  // Binary heap with lazy deletion. Accepts any key sequence.
+  class BinaryHeapQueue {
+  public:
+    void reset(std::size_t /*vertex_count*/, cost_type /*max_edge_cost*/) { heap_.clear(); }
+
+    void push(cost_type key, index_type vertex) {
+      heap_.emplace_back(key, vertex);
+      std::push_heap(heap_.begin(), heap_.end(), std::greater<>{});
+    }
+
+    PriorityQueueItem pop() {
+      std::pop_heap(heap_.begin(), heap_.end(), std::greater<>{});
+      auto item = heap_.back();
+      heap_.pop_back();
+      return item;
+    }
+
+    cost_type min_key() const { return heap_.empty() ? kUnreachable : heap_.front().first; }
+    bool empty() const { return heap_.empty(); }
+
+  private:
+    std::vector<PriorityQueueItem> heap_; // Storage kept across searches
+  };
+
+  // d-ary heap with decrease-key: pushing a vertex that is already queued
+  // lowers its key in place, so the queue never holds outdated entries. A
+  // wider node makes the heap shallower for more comparisons per level.
+  template <std::size_t Arity = 4>
+  class DaryHeapQueue {
+  public:
+    static_assert(Arity >= 2, "A heap node needs at least two children");
+
+    void reset(std::size_t vertex_count, cost_type /*max_edge_cost*/) {
+      // Only the entries left over from the previous search need clearing
+      for (const auto& item : heap_) positions_[item.second] = kNotQueued;
+      heap_.clear();
+      if (positions_.size() < vertex_count) positions_.resize(vertex_count, kNotQueued);
+    }
+
+    void push(cost_type key, index_type vertex) {
+      auto position = positions_[vertex];
+      if (position == kNotQueued) {
+        position = heap_.size();
+        heap_.emplace_back(key, vertex);
+      } else if (key < heap_[position].first) {
+        heap_[position].first = key;
+      } else {
+        return;
+      }
+      sift_up(position);
+    }
+
+    PriorityQueueItem pop() {
+      const auto top = heap_.front();
+      positions_[top.second] = kNotQueued;
+      heap_.front() = heap_.back();
+      heap_.pop_back();
+      if (!heap_.empty()) sift_down(0);
+      return top;
+    }
+
+    cost_type min_key() const { return heap_.empty() ? kUnreachable : heap_.front().first; }
+    bool empty() const { return heap_.empty(); }
+
+  private:
+    static constexpr std::size_t kNotQueued = std::numeric_limits<std::size_t>::max();
+
+    void place(std::size_t position, const PriorityQueueItem& item) {
+      heap_[position] = item;
+      positions_[item.second] = position;
+    }
+
+    void sift_up(std::size_t position) {
+      const auto item = heap_[position];
+      while (position > 0) {
+        const auto parent = (position - 1) / Arity;
+        if (!(item < heap_[parent])) break;
+        place(position, heap_[parent]);
+        position = parent;
+      }
+      place(position, item);
+    }
+
+    void sift_down(std::size_t position) {
+      const auto item = heap_[position];
+      while (true) {
+        const auto first_child = position * Arity + 1;
+        if (first_child >= heap_.size()) break;
+        const auto last_child = std::min(first_child + Arity, heap_.size());
+        auto best = first_child;
+        for (auto child = first_child + 1; child < last_child; ++child) {
+          if (heap_[child] < heap_[best]) best = child;
+        }
+        if (!(heap_[best] < item)) break;
+        place(position, heap_[best]);
+        position = best;
+      }
+      place(position, item);
+    }
+
+    std::vector<PriorityQueueItem> heap_;
+    std::vector<std::size_t> positions_; // Heap position of each vertex, or kNotQueued
+  };
+
+  // Dial's bucket queue for integer costs. Dijkstra only queues keys between
+  // the last popped key and that plus max_edge_cost, so max_edge_cost + 1
+  // circular buckets hold one key each and push/pop are O(1) amortised. Best
+  // suited to graphs whose maximum edge cost is small.
+  class DialQueue {
+  public:
+    static_assert(std::is_integral_v<cost_type>, "Dial's buckets need integer costs");
+    static constexpr std::size_t kMaxBuckets = kMaxBucketCount;
+
+    void reset(std::size_t /*vertex_count*/, cost_type max_edge_cost) {
+      if (max_edge_cost >= kMaxBuckets) {
+        throw std::length_error("Edge costs too large for a bucket queue");
+      }
+      const auto bucket_count = static_cast<std::size_t>(max_edge_cost) + 1;
+      if (buckets_.size() != bucket_count) {
+        buckets_.assign(bucket_count, {});
+      } else if (size_ > 0) {
+        for (auto& bucket : buckets_) bucket.clear();
+      }
+      current_ = 0;
+      size_ = 0;
+    }
+
+    void push(cost_type key, index_type vertex) {
+      buckets_[key % buckets_.size()].push_back(vertex);
+      ++size_;
+    }
+
+    PriorityQueueItem pop() {
+      advance();
+      auto& bucket = buckets_[current_ % buckets_.size()];
+      const auto vertex = bucket.back();
+      bucket.pop_back();
+      --size_;
+      return {current_, vertex};
+    }
+
+    cost_type min_key() {
+      if (size_ == 0) return kUnreachable;
+      advance();
+      return current_;
+    }
+
+    bool empty() const { return size_ == 0; }
+
+  private:
+    void advance() {
+      while (buckets_[current_ % buckets_.size()].empty()) ++current_;
+    }
+
+    std::vector<std::vector<index_type>> buckets_; // The key of an entry is implied by its bucket
+    cost_type current_{0};                         // Key of the bucket under the cursor
+    std::size_t size_{0};
+  };
+
+  // Radix heap for integer costs with monotone pops. An entry lives in the
+  // bucket numbered by the highest bit in which its key differs from the
+  // last popped key, so each entry moves down at most once per bit and pops
+  // cost O(log C) amortised for any edge cost range.
+  class RadixHeapQueue {
+  public:
+    static_assert(std::is_integral_v<cost_type>, "Radix buckets need integer costs");
+
+    void reset(std::size_t /*vertex_count*/, cost_type /*max_edge_cost*/) {
+      if (size_ > 0) {
+        for (auto& bucket : buckets_) bucket.clear();
+      }
+      last_ = 0;
+      size_ = 0;
+    }
+
+    void push(cost_type key, index_type vertex) {
+      buckets_[bucket_of(key)].emplace_back(key, vertex);
+      ++size_;
+    }
+
+    PriorityQueueItem pop() {
+      refill();
+      const auto item = buckets_[0].back();
+      buckets_[0].pop_back();
+      --size_;
+      return item;
+    }
+
+    cost_type min_key() {
+      if (size_ == 0) return kUnreachable;
+      refill();
+      return last_;
+    }
+
+    bool empty() const { return size_ == 0; }
+
+  private:
+    static constexpr std::size_t kBucketCount = std::numeric_limits<cost_type>::digits + 1;
+
+    std::size_t bucket_of(cost_type key) const {
+      std::size_t width = 0;
+      for (auto differing = key ^ last_; differing != 0; differing >>= 1) ++width;
+      return width;
+    }
+
+    // Makes bucket 0 hold the entries with the smallest key by redistributing
+    // the first non-empty bucket around its minimum.
+    void refill() {
+      if (!buckets_[0].empty()) return;
+      std::size_t index = 1;
+      while (buckets_[index].empty()) ++index;
+      auto& bucket = buckets_[index];
+      last_ = std::min_element(bucket.begin(), bucket.end())->first;
+      for (const auto& item : bucket) buckets_[bucket_of(item.first)].push_back(item);
+      bucket.clear();
+    }
+
+    std::array<std::vector<PriorityQueueItem>, kBucketCount> buckets_;
+    cost_type last_{0}; // Last popped key; no smaller key may be pushed
+    std::size_t size_{0};
+  };
+
+  // Per-vertex search state of one search direction. Labels are stamped with
+  // the generation that wrote them, so starting a new search is O(1): labels
+  // from older generations read as unreached without ever being cleared.
+  // Stats receives the search events of the query, see QueryStats.
+  template <typename Queue, typename Stats = NoQueryStats>
+  class BasicSearchSpace {
+  public:
+    struct Label {
+      cost_type distance;     // Best known cost from the search origin
+      index_type predecessor; // Vertex the best path arrives from
+      id_type edge_used;      // Edge the best path arrives through
+      bool settled;           // Distance is final
+    };
+
+    // Starts a new search over a graph with vertex_count vertices. Only grows
+    // the arrays when the graph has grown since the previous search.
+    void reset(std::size_t vertex_count, cost_type max_edge_cost = 0) {
+      if (labels_.size() < vertex_count) {
+        labels_.resize(vertex_count);
+        stamps_.resize(vertex_count, 0);
+      }
+      if (++generation_ == 0) {
+        // The stamp wrapped around, forget every label for real once
+        std::fill(stamps_.begin(), stamps_.end(), 0);
+        generation_ = 1;
+      }
+      queue_.reset(vertex_count, max_edge_cost);
+    }
+
+    bool reached(index_type vertex) const { return stamps_[vertex] == generation_; }
+    bool settled(index_type vertex) const { return reached(vertex) && labels_[vertex].settled; }
+    cost_type distance(index_type vertex) const { return reached(vertex) ? labels_[vertex].distance : kUnreachable; }
+    const Label& label(index_type vertex) const { return labels_[vertex]; }
+
+    // Returns the label of vertex, initialising it as unreached if it was
+    // written by an older search.
+    Label& touch(index_type vertex) {
+      if (stamps_[vertex] != generation_) {
+        stamps_[vertex] = generation_;
+        labels_[vertex] = Label{kUnreachable, vertex, 0, false};
+      }
+      return labels_[vertex];
+    }
+
+    void push(cost_type cost, index_type vertex) {
+      stats_.pushed();
+      queue_.push(cost, vertex);
+    }
+    PriorityQueueItem pop() { return queue_.pop(); }
+    bool queue_empty() const { return queue_.empty(); }
+
+    // Smallest key in the queue. May belong to an already settled vertex, in
+    // which case it is still a valid lower bound for the unsettled ones.
+    cost_type queue_min() { return queue_.min_key(); }
+
+    Stats& stats() { return stats_; }
+    const Stats& stats() const { return stats_; }
+
+  private:
+    std::vector<Label> labels_;
+    std::vector<std::uint32_t> stamps_;
+    std::uint32_t generation_{0};
+    Queue queue_; // Storage kept across searches
+    Stats stats_;
+  };
+
+  using SearchSpace = BasicSearchSpace<BinaryHeapQueue>;
+
+  // Scratch memory for queries. Keep one per thread and pass it to the
+  // shortest_path() overloads: after the first query on a graph of a given
+  // size, further queries allocate nothing for their search state and cost
+  // only as much as the vertices they touch. The Queue policy selects the
+  // priority queue of the Dijkstra searches run with it.
+  //
+  // With Stats = QueryStats the workspace also records what each query run
+  // with it did: shortest_path(), shortest_distance() and try_shortest_path()
+  // count settled vertices, queue pushes, stale pops and relaxed edges and
+  // time the search and the path reconstruction. The default NoQueryStats
+  // compiles all of that away.
+  template <typename Queue, typename Stats = NoQueryStats>
+  class BasicQueryWorkspace {
+  public:
+    using stats_type = Stats;
+
+    BasicQueryWorkspace() = default;
+
+    // Counters of the last query, over both search directions.
+    QueryCounters stats() const {
+      static_assert(Stats::kEnabled, "The workspace was declared without QueryStats");
+      auto counters = forward_.stats().counters();
+      counters += backward_.stats().counters();
+      return counters;
+    }
+
+    // From now on also adds every finished query to totals, which other
+    // workspaces may share; nullptr stops it. totals must outlive its use.
+    void aggregate_into(AggregateQueryStats* totals) {
+      static_assert(Stats::kEnabled, "The workspace was declared without QueryStats");
+      aggregate_ = totals;
+    }
+
+  private:
+    template <typename, typename, typename>
+    friend class ShortestPathQueries;
+    friend class BasicContractionHierarchy<Id, Cost>;
+
+    BasicSearchSpace<Queue, Stats> forward_;
+    BasicSearchSpace<Queue, Stats> backward_;
+    AggregateQueryStats* aggregate_{nullptr};
+  };
+
+  using QueryWorkspace = BasicQueryWorkspace<BinaryHeapQueue>;
+
+  enum class PathStatus {
+    found,          // The output buffers hold the path
+    no_path,        // The destination cannot be reached from the source
+    invalid_vertex, // One of the ids is not a vertex of the graph
+  };
+
+  enum class SearchMode {
+    unidirectional, // Grow one search from the source until the destination is settled
+    bidirectional,  // Grow searches from both ends until they provably meet
+  };
+
+  // Costs between every source and every target of a distance_table() call,
+  // row-major by source. Paths are only filled in when requested.
+  struct DistanceTable {
+    std::size_t source_count{0};
+    std::size_t target_count{0};
+    std::vector<cost_type> costs; // kUnreachable where there is no path
+    std::vector<std::tuple<std::vector<id_type>, std::vector<id_type>>> paths;
+
+    cost_type cost(std::size_t source, std::size_t target) const { return costs[source * target_count + target]; }
+    const std::tuple<std::vector<id_type>, std::vector<id_type>>& path(std::size_t source, std::size_t target) const {
+      return paths.at(source * target_count + target);
+    }
+  };
+
+  // Cheapest costs between every vertex and the nearest of a set of origins,
+  // from a single search with all origins queued at cost 0. Entry i of each
+  // array describes the vertex vertex_ids[i]. In a cost-to-go field, built by
+  // searching the reverse graph, next_edges[i] is the first edge of a
+  // cheapest path from the vertex to an origin, so repeatedly following
+  // next_edge() descends the field to a goal. In a forward field it is the
+  // last edge of a cheapest path from an origin. Origins and vertices that no
+  // origin connects to keep kNoEdge; the latter also cost kUnreachable.
+  struct CostField {
+    bool to_origins{false}; // Cost-to-go field
+    std::vector<id_type> vertex_ids;
+    std::vector<cost_type> costs;
+    std::vector<id_type> next_edges;
+    std::vector<index_type> next; // Position of the vertex at the other end of next_edges[i]
+
+    cost_type cost(id_type vertex_id) const { return costs[sorted_index_of(vertex_ids, vertex_id)]; }
+    id_type next_edge(id_type vertex_id) const { return next_edges[sorted_index_of(vertex_ids, vertex_id)]; }
+
+    // Cheapest path between the vertex and its nearest origin, in the
+    // direction of travel: from the vertex in a cost-to-go field, to it
+    // otherwise.
+    std::tuple<std::vector<id_type>, std::vector<id_type>> path(id_type vertex_id) const {
+      auto current = sorted_index_of(vertex_ids, vertex_id);
+      if (costs[current] == kUnreachable) {
+        throw std::runtime_error("No path found");
+      }
+      std::vector<id_type> nodes{vertex_ids[current]}, edges;
+      for (; next_edges[current] != kNoEdge; current = next[current]) {
+        edges.push_back(next_edges[current]);
+        nodes.push_back(vertex_ids[next[current]]);
+      }
+      if (!to_origins) {
+        std::reverse(nodes.begin(), nodes.end());
+        std::reverse(edges.begin(), edges.end());
+      }
+      return std::make_tuple(std::move(nodes), std::move(edges));
+    }
+  };
+
+  // One of the paths found by k_shortest_paths().
+  struct AlternativePath {
+    cost_type cost;
+    std::tuple<std::vector<id_type>, std::vector<id_type>> path; // Nodes and edges, as from shortest_path()
+  };
+
+  // One of the targets found by nearest_targets().
+  struct TargetPath {
+    id_type target;
+    cost_type cost;
+    std::tuple<std::vector<id_type>, std::vector<id_type>> path; // Nodes and edges, as from shortest_path()
+  };
+
+  // Every shortest path out of one source. Entry i of each array describes
+  // the vertex vertex_ids[i]; vertices the source cannot reach keep
+  // kUnreachable and kNoEdge, as does the source's predecessor edge.
+  struct ShortestPathTree {
+    id_type source{0};
+    std::vector<id_type> vertex_ids;
+    std::vector<cost_type> distances;
+    std::vector<id_type> predecessor_edges;
+    std::vector<index_type> predecessors; // Position of the vertex each path arrives from
+
+    cost_type distance(id_type vertex_id) const { return distances[sorted_index_of(vertex_ids, vertex_id)]; }
+    id_type predecessor_edge(id_type vertex_id) const {
+      return predecessor_edges[sorted_index_of(vertex_ids, vertex_id)];
+    }
+
+    // A shortest path from source to vertex_id, read off the tree. Its cost
+    // matches shortest_path(source, vertex_id), but on ties the two may pick
+    // different paths.
+    std::tuple<std::vector<id_type>, std::vector<id_type>> path(id_type vertex_id) const {
+      auto current = sorted_index_of(vertex_ids, vertex_id);
+      if (distances[current] == kUnreachable) {
+        throw std::runtime_error("No path found");
+      }
+      std::vector<id_type> nodes{vertex_ids[current]}, edges;
+      for (; predecessor_edges[current] != kNoEdge; current = predecessors[current]) {
+        edges.push_back(predecessor_edges[current]);
+        nodes.push_back(vertex_ids[predecessors[current]]);
+      }
+      std::reverse(nodes.begin(), nodes.end());
+      std::reverse(edges.begin(), edges.end());
+      return std::make_tuple(std::move(nodes), std::move(edges));
+    }
+  };
+
+  // Distances to and from a few landmark vertices, used by the ALT lower
+  // bound: by the triangle inequality, for any landmark L and target t
+  //   d(v, t) >= d(L, t) - d(L, v)   and   d(v, t) >= d(v, L) - d(t, L).
+  // Only valid for the graph it was computed on; rebuild it after adding edges.
+  class Landmarks {
+  public:
+    Landmarks() = default;
+
+    const std::vector<id_type>& ids() const { return ids_; }
+    std::size_t size() const { return ids_.size(); }
+
+  private:
+    template <typename, typename, typename>
+    friend class ShortestPathQueries;
+
+    // Lower bound for the cost from vertex to target. Returns kUnreachable if
+    // the landmark distances prove that target cannot be reached.
+    cost_type lower_bound(index_type vertex, index_type target) const {
+      if (vertex >= vertex_count_ || target >= vertex_count_) return 0;
+      cost_type bound = 0;
+      for (std::size_t l = 0; l < ids_.size(); ++l) {
+        const auto row = l * vertex_count_;
+        bound = std::max(bound, difference(from_landmark_[row + target], from_landmark_[row + vertex]));
+        bound = std::max(bound, difference(to_landmark_[row + vertex], to_landmark_[row + target]));
+        if (bound == kUnreachable) break;
+      }
+      return bound;
+    }
+
+    // a - b as a lower bound, where either side may be unreachable.
+    static cost_type difference(cost_type a, cost_type b) {
+      if (b == kUnreachable) return 0;
+      if (a == kUnreachable) return kUnreachable;
+      return a > b ? a - b : 0;
+    }
+
+    std::vector<id_type> ids_;
+    std::size_t vertex_count_{0};
+    std::vector<cost_type> from_landmark_; // d(L, v), one row of vertex_count_ per landmark
+    std::vector<cost_type> to_landmark_;   // d(v, L), one row of vertex_count_ per landmark
+  };
+
+protected:
+  struct ConnectionListItem {
+    index_type vertex;   // Dense index of the vertex at the other end
+    id_type edge_id;     // Edge ID
+    cost_type edge_cost; // Edge cost
+  };
+
+  // Contiguous run of edges, either one adjacency vector or one CSR row.
+  struct EdgeRange {
+    const ConnectionListItem* first;
+    const ConnectionListItem* last;
+    const ConnectionListItem* begin() const { return first; }
+    const ConnectionListItem* end() const { return last; }
+    std::size_t size() const { return static_cast<std::size_t>(last - first); }
+  };
+
+  // Vertex ids come from a monotonic counter, so a table of ids in dense
+  // index order is sorted and a binary search maps an id back to its index.
+  template <typename Ids>
+  static bool sorted_find_index(const Ids& vertex_ids, id_type vertex_id, index_type& index) {
+    auto it = std::lower_bound(vertex_ids.begin(), vertex_ids.end(), vertex_id);
+    if (it == vertex_ids.end() || *it != vertex_id) return false;
+    index = static_cast<index_type>(it - vertex_ids.begin());
+    return true;
+  }
+
+  template <typename Ids>
+  static index_type sorted_index_of(const Ids& vertex_ids, id_type vertex_id) {
+    index_type index = 0;
+    if (!sorted_find_index(vertex_ids, vertex_id, index)) {
+      throw std::runtime_error("Invalid vertex");
+    }
+    return index;
+  }
+};
+
+// Contraction hierarchy over a static graph. Preprocessing contracts the
+// vertices one by one in order of importance, adding a shortcut u -> w for
+// every u -> v -> w that was the only shortest way around a contracted v.
+// Afterwards any shortest path climbs to its most important vertex and
+// descends again, so a query is a bidirectional search that only follows arcs
+// towards more important vertices and settles a tiny part of the graph.
+// Shortcuts remember the two arcs they bridge and are unpacked into the
+// original edge ids when a path is returned.
+template <typename Id, typename Cost>
+class BasicContractionHierarchy : public BasicShortestPathTypes<Id, Cost> {
+  using Types = BasicShortestPathTypes<Id, Cost>;
+
+public:
+  using typename Types::id_type;
+  using typename Types::cost_type;
+  using typename Types::index_type;
+  using typename Types::QueryWorkspace;
+  using Types::kUnreachable;
+
+  BasicContractionHierarchy() = default;
+
+  std::size_t vertex_count() const { return vertex_ids_.size(); }
+  std::size_t shortcut_count() const { return shortcut_count_; }
+
+  // Same contract as ShortestPathCalculator::shortest_path().
+  auto shortest_path(id_type src_node_id, id_type dest_node_id, QueryWorkspace& workspace) const {
+    const auto src = sorted_index_of(vertex_ids_, src_node_id);
+    const auto dest = sorted_index_of(vertex_ids_, dest_node_id);
+    auto& forward = workspace.forward_;
+    auto& backward = workspace.backward_;
+    forward.reset(vertex_count());
+    backward.reset(vertex_count());
+    forward.touch(src).distance = 0;
+    forward.push(0, src);
+    backward.touch(dest).distance = 0;
+    backward.push(0, dest);
+
+    cost_type best = src == dest ? 0 : kUnreachable;
+    index_type meeting_vertex = src;
+
+    // Labels store the CH arc index in edge_used until the path is unpacked
+    auto step = [&](SearchSpace& self, const SearchSpace& other, const std::vector<std::size_t>& offsets,
+                    const std::vector<UpwardArc>& upward) {
+      auto [current_cost, current] = self.pop();
+      auto& current_label = self.touch(current);
+      if (current_label.settled) return;
+      current_label.settled = true;
+
+      for (auto i = offsets[current]; i < offsets[current + 1]; ++i) {
+        const auto& arc = upward[i];
+        auto& label = self.touch(arc.vertex);
+        if (label.settled) continue;
+        cost_type new_cost = add_costs(current_cost, arc.cost);
+        if (new_cost < label.distance) {
+          label.distance = new_cost;
+          label.predecessor = current;
+          label.edge_used = static_cast<id_type>(arc.arc);
+          self.push(new_cost, arc.vertex);
+
+          const auto other_cost = other.distance(arc.vertex);
+          if (other_cost != kUnreachable && add_costs(new_cost, other_cost) < best) {
+            best = add_costs(new_cost, other_cost);
+            meeting_vertex = arc.vertex;
+          }
+        }
+      }
+    };
+
+    // Unlike plain bidirectional search, the upward searches do not meet in
+    // the middle of the path, so each side runs until it cannot improve best
+    while (true) {
+      const auto forward_min = forward.queue_min();
+      const auto backward_min = backward.queue_min();
+      if (std::min(forward_min, backward_min) >= best) break;
+      if (forward_min <= backward_min) {
+        step(forward, backward, up_offsets_, up_arcs_);
+      } else {
+        step(backward, forward, down_offsets_, down_arcs_);
+      }
+    }
+
+    if (best == kUnreachable) {
+      throw std::runtime_error("No path found");
+    }
+
+    // Collect the CH arcs of the path in order, then unpack them
+    std::vector<std::size_t> path_arcs;
+    for (auto current = meeting_vertex; current != src; current = forward.label(current).predecessor) {
+      path_arcs.push_back(forward.label(current).edge_used);
+    }
+    std::reverse(path_arcs.begin(), path_arcs.end());
+    for (auto current = meeting_vertex; current != dest; current = backward.label(current).predecessor) {
+      path_arcs.push_back(backward.label(current).edge_used);
+    }
+
+    std::vector<id_type> nodes{src_node_id}, edges;
+    std::vector<std::size_t> pending;
+    for (const auto path_arc : path_arcs) {
+      pending.push_back(path_arc);
+      while (!pending.empty()) {
+        const auto& arc = arcs_[pending.back()];
+        pending.pop_back();
+        if (arc.first == kNoArc) {
+          nodes.push_back(vertex_ids_[arc.to]);
+          edges.push_back(arc.edge_id);
+        } else {
+          pending.push_back(arc.second);
+          pending.push_back(arc.first);
+        }
+      }
+    }
+    return std::make_tuple(nodes, edges);
+  }
+
+  auto shortest_path(id_type src_node_id, id_type dest_node_id) const {
+    QueryWorkspace workspace;
+    return shortest_path(src_node_id, dest_node_id, workspace);
+  }
+
+private:
+  template <typename, typename, typename>
+  friend class ShortestPathQueries;
+
+  using typename Types::SearchSpace;
+  using Types::add_costs;
+  using Types::sorted_index_of;
+
+  static constexpr std::size_t kNoArc = std::numeric_limits<std::size_t>::max();
+
+  struct Arc {
+    index_type from;   // Tail vertex
+    index_type to;     // Head vertex
+    cost_type cost;    // Total cost, including every bridged arc
+    id_type edge_id;   // Original edge, when first == kNoArc
+    std::size_t first; // Shortcuts bridge arcs first (from -> v) and
+    std::size_t second; // second (v -> to)
+  };
+
+  struct UpwardArc {
+    index_type vertex; // Neighbour of higher rank
+    cost_type cost;
+    std::size_t arc; // Index into arcs_
+  };
+
+  // Settled-vertex budget of one witness search. Giving up early only costs
+  // an unnecessary shortcut, never correctness.
+  static constexpr std::size_t kWitnessSettleLimit = 64;
+
+  // Contracts every vertex of a graph given as its vertex id table and one
+  // arc per original edge.
+  BasicContractionHierarchy(std::vector<id_type> vertex_ids, std::vector<Arc> arcs)
+      : vertex_ids_(std::move(vertex_ids)), arcs_(std::move(arcs)) {
+    const auto n = vertex_ids_.size();
+
+    // Remaining graph: arcs between uncontracted vertices, cheapest per pair
+    std::vector<std::vector<std::size_t>> out(n), in(n);
+    for (std::size_t a = 0; a < arcs_.size(); ++a) {
+      const auto& arc = arcs_[a];
+      if (arc.from != arc.to) add_remaining_arc(out, in, a);
+    }
+
+    std::vector<bool> contracted(n, false);
+    std::vector<std::size_t> level(n, 0); // Depth in the hierarchy so far
+    std::vector<std::vector<std::size_t>> up(n), down(n);
+    SearchSpace witness;
+    std::vector<Arc> shortcuts;
+
+    // Edge difference plus depth: prefer vertices whose removal shrinks the
+    // graph, and spread the contraction evenly instead of growing one branch
+    auto priority = [&](index_type v) {
+      shortcuts.clear();
+      find_shortcuts(v, out, in, witness, shortcuts);
+      const auto removed = out[v].size() + in[v].size();
+      return static_cast<long long>(shortcuts.size()) - static_cast<long long>(removed) +
+             static_cast<long long>(level[v]);
+    };
+
+    // Lazy updates: a popped vertex is contracted only if its recomputed
+    // priority is still no worse than the next candidate's. Entries whose
+    // priority is out of date are skipped.
+    using OrderItem = std::pair<long long, index_type>;
+    std::priority_queue<OrderItem, std::vector<OrderItem>, std::greater<>> order;
+    std::vector<long long> current_priority(n);
+    auto enqueue = [&](index_type v) {
+      current_priority[v] = priority(v);
+      order.emplace(current_priority[v], v);
+    };
+    auto discard_stale = [&] {
+      while (!order.empty() &&
+             (contracted[order.top().second] || order.top().first != current_priority[order.top().second])) {
+        order.pop();
+      }
+    };
+    for (index_type v = 0; v < n; ++v) enqueue(v);
+
+    while (discard_stale(), !order.empty()) {
+      const auto v = order.top().second;
+      order.pop();
+      const auto current = priority(v);
+      discard_stale();
+      if (!order.empty() && current > order.top().first) {
+        current_priority[v] = current;
+        order.emplace(current, v);
+        continue;
+      }
+
+      // The remaining arcs of v all lead to vertices contracted later
+      up[v] = out[v];
+      down[v] = in[v];
+      for (auto& shortcut : shortcuts) {
+        arcs_.push_back(shortcut);
+        if (add_remaining_arc(out, in, arcs_.size() - 1)) {
+          ++shortcut_count_;
+        } else {
+          arcs_.pop_back();
+        }
+      }
+      contracted[v] = true;
+      for (const auto a : out[v]) {
+        remove_remaining_arc(in[arcs_[a].to], a);
+        level[arcs_[a].to] = std::max(level[arcs_[a].to], level[v] + 1);
+      }
+      for (const auto a : in[v]) {
+        remove_remaining_arc(out[arcs_[a].from], a);
+        level[arcs_[a].from] = std::max(level[arcs_[a].from], level[v] + 1);
+      }
+    }
+
+    // Pack the upward arcs of both directions into CSR arrays
+    up_offsets_.assign(1, 0);
+    down_offsets_.assign(1, 0);
+    for (index_type v = 0; v < n; ++v) {
+      for (const auto a : up[v]) up_arcs_.push_back(UpwardArc{arcs_[a].to, arcs_[a].cost, a});
+      for (const auto a : down[v]) down_arcs_.push_back(UpwardArc{arcs_[a].from, arcs_[a].cost, a});
+      up_offsets_.push_back(up_arcs_.size());
+      down_offsets_.push_back(down_arcs_.size());
+    }
+  }
+
+  // Adds arc a to the remaining graph, unless an arc at least as cheap
+  // already joins the same pair; a more expensive one is replaced. Returns
+  // whether arc a was kept.
+  bool add_remaining_arc(std::vector<std::vector<std::size_t>>& out, std::vector<std::vector<std::size_t>>& in,
+                         std::size_t a) const {
+    const auto& arc = arcs_[a];
+    for (auto& existing : out[arc.from]) {
+      if (arcs_[existing].to != arc.to) continue;
+      if (arcs_[existing].cost <= arc.cost) return false;
+      std::replace(in[arc.to].begin(), in[arc.to].end(), existing, a);
+      existing = a;
+      return true;
+    }
+    out[arc.from].push_back(a);
+    in[arc.to].push_back(a);
+    return true;
+  }
+
+  static void remove_remaining_arc(std::vector<std::size_t>& arcs, std::size_t a) {
+    arcs.erase(std::find(arcs.begin(), arcs.end(), a));
+  }
+
+  // Computes the shortcuts that contracting v would need: for each u -> v ->
+  // w, one unless a bounded witness search from u finds a path to w that
+  // avoids v and costs no more.
+  void find_shortcuts(index_type v, const std::vector<std::vector<std::size_t>>& out,
+                      const std::vector<std::vector<std::size_t>>& in, SearchSpace& witness,
+                      std::vector<Arc>& shortcuts) const {
+    cost_type max_outgoing = 0;
+    for (const auto a : out[v]) max_outgoing = std::max(max_outgoing, arcs_[a].cost);
+
+    for (const auto in_arc : in[v]) {
+      const auto u = arcs_[in_arc].from;
+      const auto limit = add_costs(arcs_[in_arc].cost, max_outgoing);
+
+      witness.reset(vertex_ids_.size());
+      witness.touch(u).distance = 0;
+      witness.push(0, u);
+      std::size_t settled = 0;
+      while (!witness.queue_empty() && settled < kWitnessSettleLimit) {
+        auto [current_cost, current] = witness.pop();
+        auto& current_label = witness.touch(current);
+        if (current_label.settled) continue;
+        current_label.settled = true;
+        ++settled;
+        if (current_cost > limit) break;
+        for (const auto a : out[current]) {
+          const auto next = arcs_[a].to;
+          if (next == v) continue;
+          auto& label = witness.touch(next);
+          const auto new_cost = add_costs(current_cost, arcs_[a].cost);
+          if (!label.settled && new_cost < label.distance) {
+            label.distance = new_cost;
+            witness.push(new_cost, next);
+          }
+        }
+      }
+
+      for (const auto out_arc : out[v]) {
+        const auto w = arcs_[out_arc].to;
+        if (w == u) continue;
+        const auto via = add_costs(arcs_[in_arc].cost, arcs_[out_arc].cost);
+        if (witness.distance(w) <= via) continue;
+        shortcuts.push_back(Arc{u, w, via, 0, in_arc, out_arc});
+      }
+    }
+  }
+
+  std::vector<id_type> vertex_ids_;  // Dense index -> vertex ID
+  std::vector<Arc> arcs_;            // Original edges, then shortcuts
+  std::size_t shortcut_count_{0};
+  std::vector<std::size_t> up_offsets_{0};
+  std::vector<UpwardArc> up_arcs_;   // v -> w with w contracted after v
+  std::vector<std::size_t> down_offsets_{0};
+  std::vector<UpwardArc> down_arcs_; // w -> v with w contracted after v, stored at v
+};
+
+using ContractionHierarchy = BasicContractionHierarchy<std::size_t, std::size_t>;
+
+//
+// Query algorithms shared by ShortestPathCalculator, its compact Snapshot and
+// the implicit OccupancyGrid. All of them number vertices densely (0 .. V-1),
+// so all query state lives in flat vectors indexed by that number. A Graph
+// plugged in here provides:
+//   std::size_t vertex_count() const;
+//   bool find_index(id_type vertex_id, index_type& index) const; // false on unknown ids
+//   id_type id_of(index_type index) const;
+//   Edges out_edges(index_type index) const;
+//   Edges in_edges(index_type index) const;      // reverse adjacency
+//   cost_type max_edge_cost() const;             // for bucket queues
+// where Edges is any range of ConnectionListItem with a size(), usually an
+// EdgeRange over stored edges.
+//
+
+template <typename Graph, typename Id, typename Cost>
+class ShortestPathQueries : public BasicShortestPathTypes<Id, Cost> {
+  using Types = BasicShortestPathTypes<Id, Cost>;
+
+public:
+  using typename Types::id_type;
+  using typename Types::cost_type;
+  using typename Types::index_type;
+  using typename Types::BinaryHeapQueue;
+  using typename Types::SearchSpace;
+  using typename Types::QueryWorkspace;
+  using typename Types::SearchMode;
+  using typename Types::PathStatus;
+  using typename Types::DistanceTable;
+  using typename Types::TargetPath;
+  using typename Types::AlternativePath;
+  using typename Types::CostField;
+  using typename Types::ShortestPathTree;
+  using typename Types::Landmarks;
+  using Types::kUnreachable;
+  using Types::kNoEdge;
+  template <typename Queue, typename Stats = NoQueryStats>
+  using BasicQueryWorkspace = typename Types::template BasicQueryWorkspace<Queue, Stats>;
+
+  // Whether vertex_id names a vertex of this graph.
+  bool has_vertex(id_type vertex_id) const {
+    index_type index = 0;
+    return graph().find_index(vertex_id, index);
+  }
+
+  // Finds the shortest path from source to destination using Dijkstra's algorithm.
+  // I used this source: https://www.youtube.com/watch?v=bZkzH5x0SKU&ab_channel=FelixTechTips (great video)
+  // Returns a tuple of nodes and edges in the path to estimate the matrix
+  auto shortest_path(id_type src_node_id, id_type dest_node_id) const {
+    QueryWorkspace workspace;
+    return shortest_path(src_node_id, dest_node_id, workspace);
+  }
+
+  auto shortest_path(id_type src_node_id, id_type dest_node_id, SearchMode mode) const {
+    QueryWorkspace workspace;
+    return shortest_path(src_node_id, dest_node_id, workspace, mode);
+  }
+
+  // A* search guided by remaining_cost(vertex_id), which must never
+  // overestimate the cost from vertex_id to dest_node_id. Heuristics that are
+  // admissible but not consistent are handled by reopening vertices.
+  template <typename Heuristic,
+            typename = std::enable_if_t<std::is_invocable_r_v<cost_type, Heuristic&, id_type>>>
+  auto shortest_path(id_type src_node_id, id_type dest_node_id, Heuristic&& remaining_cost) const {
+    QueryWorkspace workspace;
+    return shortest_path(src_node_id, dest_node_id, workspace, std::forward<Heuristic>(remaining_cost));
+  }
+
+  template <typename Heuristic,
+            typename = std::enable_if_t<std::is_invocable_r_v<cost_type, Heuristic&, id_type>>>
+  auto shortest_path(id_type src_node_id, id_type dest_node_id, QueryWorkspace& workspace,
+                     Heuristic&& remaining_cost) const {
+    const auto src = index_of(src_node_id);
+    const auto dest = index_of(dest_node_id);
+    auto& space = workspace.forward_;
+    auto estimate = [this, &remaining_cost](index_type vertex) -> cost_type {
+      return remaining_cost(graph().id_of(vertex));
+    };
+    if (!guided_search(space, src, dest, estimate)) {
+      throw std::runtime_error("No path found");
+    }
+    return trace_path(space, src, dest);
+  }
+
+  // A* search using the ALT lower bounds of previously computed landmarks.
+  auto shortest_path(id_type src_node_id, id_type dest_node_id, const Landmarks& landmarks) const {
+    QueryWorkspace workspace;
+    return shortest_path(src_node_id, dest_node_id, workspace, landmarks);
+  }
+
+  auto shortest_path(id_type src_node_id, id_type dest_node_id, QueryWorkspace& workspace,
+                     const Landmarks& landmarks) const {
+    const auto src = index_of(src_node_id);
+    const auto dest = index_of(dest_node_id);
+    auto& space = workspace.forward_;
+    auto estimate = [&landmarks, dest](index_type vertex) { return landmarks.lower_bound(vertex, dest); };
+    if (!guided_search(space, src, dest, estimate)) {
+      throw std::runtime_error("No path found");
+    }
+    return trace_path(space, src, dest);
+  }
+
+  // Precomputes ALT distances for the given landmark vertices: one forward
+  // and one backward full search per landmark.
+  Landmarks make_landmarks(const std::vector<id_type>& landmark_ids) const {
+    const auto& g = graph();
+    const auto vertex_count = g.vertex_count();
+    Landmarks landmarks;
+    landmarks.ids_ = landmark_ids;
+    landmarks.vertex_count_ = vertex_count;
+    landmarks.from_landmark_.reserve(landmark_ids.size() * vertex_count);
+    landmarks.to_landmark_.reserve(landmark_ids.size() * vertex_count);
+
+    SearchSpace space;
+    for (const auto landmark_id : landmark_ids) {
+      const auto landmark = index_of(landmark_id);
+      search(space, landmark, vertex_count, false);
+      for (index_type v = 0; v < vertex_count; ++v) landmarks.from_landmark_.push_back(space.distance(v));
+      search(space, landmark, vertex_count, true);
+      for (index_type v = 0; v < vertex_count; ++v) landmarks.to_landmark_.push_back(space.distance(v));
+    }
+    return landmarks;
+  }
+
+  // Picks count landmarks by farthest-point selection: each new landmark is
+  // the vertex farthest from its nearest landmark so far, which spreads them
+  // over the periphery of the graph where their bounds are tightest. A graph
+  // with fewer than count vertices gets every vertex as a landmark.
+  Landmarks make_landmarks(std::size_t count) const {
+    const auto& g = graph();
+    const auto vertex_count = g.vertex_count();
+    std::vector<id_type> chosen;
+    if (vertex_count == 0) return make_landmarks(chosen);
+
+    // Vertices no landmark reaches count as the farthest of all. Edge costs
+    // are non-negative, so vertices other than the landmarks can be at
+    // distance zero too; only the landmarks themselves are never picked again.
+    std::vector<cost_type> nearest(vertex_count, kUnreachable);
+    std::vector<bool> is_landmark(vertex_count, false);
+    const auto none = static_cast<index_type>(vertex_count);
+    auto farthest = [&is_landmark, none](const auto& cost_of) {
+      auto result = none;
+      for (index_type v = 0; v < none; ++v) {
+        if (!is_landmark[v] && (result == none || cost_of(v) > cost_of(result))) result = v;
+      }
+      return result;
+    };
+
+    // Start from the vertex farthest from an arbitrary one
+    SearchSpace space;
+    search(space, 0, vertex_count);
+    auto next = farthest([&space](index_type v) { return space.reached(v) ? space.distance(v) : 0; });
+
+    while (chosen.size() < count && next != none) {
+      chosen.push_back(g.id_of(next));
+      is_landmark[next] = true;
+      search(space, next, vertex_count);
+      for (index_type v = 0; v < vertex_count; ++v) nearest[v] = std::min(nearest[v], space.distance(v));
+      next = farthest([&nearest](index_type v) { return nearest[v]; });
+    }
+    return make_landmarks(chosen);
+  }
+
+  // Computes the cost from every source to every target with one search per
+  // source that stops once all targets are settled. Sources are spread over
+  // the pool's workers, each with its own workspace. Paths are only traced
+  // when with_paths is set; missing ones are left empty.
+  template <typename Queue = BinaryHeapQueue>
+  DistanceTable distance_table(const std::vector<id_type>& sources, const std::vector<id_type>& targets,
+                               ThreadPool& pool, bool with_paths = false) const {
+    const auto& g = graph();
+    std::vector<index_type> source_indices, target_indices;
+    for (const auto source : sources) source_indices.push_back(index_of(source));
+    for (const auto target : targets) target_indices.push_back(index_of(target));
+
+    // Shared read-only target lookup; repeated targets only count once
+    std::vector<bool> is_target(g.vertex_count(), false);
+    std::size_t distinct_targets = 0;
+    for (const auto target : target_indices) {
+      if (!is_target[target]) ++distinct_targets;
+      is_target[target] = true;
+    }
+
+    DistanceTable table;
+    table.source_count = sources.size();
+    table.target_count = targets.size();
+    table.costs.assign(sources.size() * targets.size(), kUnreachable);
+    if (with_paths) table.paths.resize(table.costs.size());
+
+    std::vector<BasicQueryWorkspace<Queue>> workspaces(pool.size());
+    pool.parallel_for(source_indices.size(), [&](std::size_t row, std::size_t worker) {
+      auto& space = workspaces[worker].forward_;
+      const auto src = source_indices[row];
+      auto remaining = distinct_targets;
+      search_until(space, src, [&](index_type vertex) { return is_target[vertex] && --remaining == 0; });
+
+      for (std::size_t column = 0; column < target_indices.size(); ++column) {
+        const auto target = target_indices[column];
+        if (!space.settled(target)) continue;
+        const auto cell = row * table.target_count + column;
+        table.costs[cell] = space.distance(target);
+        if (with_paths) table.paths[cell] = trace_path(space, src, target);
+      }
+    });
+    return table;
+  }
+
+  template <typename Queue = BinaryHeapQueue>
+  DistanceTable distance_table(const std::vector<id_type>& sources, const std::vector<id_type>& targets,
+                               bool with_paths = false) const {
+    ThreadPool pool;
+    return distance_table<Queue>(sources, targets, pool, with_paths);
+  }
+
+  // Computes the shortest path tree of src with parallel delta-stepping.
+  // Tentative distances are kept in buckets bucket_width wide. All vertices
+  // of the lowest non-empty bucket are settled together: their light edges
+  // (cost <= bucket_width) are relaxed in rounds until the bucket stays empty,
+  // then their heavy edges once, since those can only reach later buckets.
+  // Vertices are partitioned over the pool's workers by index; each round
+  // workers first emit relaxation requests to the owners of the targets and
+  // then every owner applies the requests it received, so per-vertex state
+  // is only ever written by one thread. A bucket_width of 0 picks the
+  // largest edge cost divided by the average out-degree.
+  ShortestPathTree shortest_path_tree(id_type src_node_id, ThreadPool& pool, cost_type bucket_width = 0) const {
+    const auto& g = graph();
+    const auto src = index_of(src_node_id);
+    const auto vertex_count = g.vertex_count();
+
+    ShortestPathTree tree;
+    tree.source = src_node_id;
+    tree.vertex_ids.reserve(vertex_count);
+    std::size_t edge_count = 0;
+    for (index_type v = 0; v < vertex_count; ++v) {
+      tree.vertex_ids.push_back(g.id_of(v));
+      edge_count += g.out_edges(v).size();
+    }
+    tree.distances.assign(vertex_count, kUnreachable);
+    tree.predecessor_edges.assign(vertex_count, kNoEdge);
+    tree.predecessors.resize(vertex_count);
+    for (index_type v = 0; v < vertex_count; ++v) tree.predecessors[v] = v;
+
+    // Relaxations never reach more than max_edge_cost / width + 1 buckets
+    // past the current one (one more for rounding with floating point
+    // costs), so a ring of buckets is enough
+    const auto max_edge_cost = g.max_edge_cost();
+    if (!(bucket_width > 0)) {
+      const auto average_degree = std::max<std::size_t>(edge_count / std::max<std::size_t>(vertex_count, 1), 1);
+      bucket_width = max_edge_cost / static_cast<cost_type>(average_degree);
+      if (!(bucket_width > 0)) bucket_width = max_edge_cost > 0 ? max_edge_cost : 1;
+    }
+    if (!(max_edge_cost / bucket_width < static_cast<cost_type>(kMaxBucketCount))) {
+      throw std::length_error("Bucket width too small for the edge costs");
+    }
+    const std::size_t ring_size = static_cast<std::size_t>(max_edge_cost / bucket_width) + 3;
+
+    struct Relaxation {
+      index_type target;
+      cost_type distance;
+      index_type from;
+      id_type edge;
+    };
+    struct Partition {
+      std::vector<std::vector<index_type>> buckets;  // Ring of buckets of owned vertices
+      std::vector<index_type> frontier;              // Vertices settled in the current round
+      std::vector<index_type> settled;               // Vertices settled in the current bucket
+      std::vector<std::vector<Relaxation>> outbox;   // Requests for each target partition
+    };
+    const auto partition_count = pool.size();
+    std::vector<Partition> partitions(partition_count);
+    for (auto& partition : partitions) {
+      partition.buckets.resize(ring_size);
+      partition.outbox.resize(partition_count);
+    }
+    auto owner = [partition_count](index_type v) { return v % partition_count; };
+
+    // Absolute number of the bucket a vertex is queued in, so stale entries
+    // left behind in other buckets are recognised and skipped
+    constexpr std::size_t kNotQueued = std::numeric_limits<std::size_t>::max();
+    std::vector<std::size_t> queued_bucket(vertex_count, kNotQueued);
+    // Pass in which a vertex was last added to its partition's settled list.
+    // A vertex improved again within the same bucket comes round once per
+    // light round, but its heavy edges only need relaxing once per pass
+    std::vector<std::size_t> settled_pass(vertex_count, kNotQueued);
+    std::size_t pass = 0;
+    std::size_t current = 0;
+    // Never behind the bucket being processed, in case rounding says otherwise
+    auto enqueue = [&](index_type v, cost_type distance) {
+      const auto bucket = std::max(static_cast<std::size_t>(distance / bucket_width), current);
+      if (queued_bucket[v] == bucket) return;
+      queued_bucket[v] = bucket;
+      partitions[owner(v)].buckets[bucket % ring_size].push_back(v);
+    };
+
+    auto emit = [&](Partition& partition, index_type v, bool light) {
+      const auto distance = tree.distances[v];
+      for (const auto& edge : g.out_edges(v)) {
+        if ((edge.edge_cost <= bucket_width) != light) continue;
+        partition.outbox[owner(edge.vertex)].push_back(
+            Relaxation{edge.vertex, add_costs(distance, edge.edge_cost), v, edge.edge_id});
+      }
+    };
+
+    auto apply = [&](std::size_t target_partition, std::size_t) {
+      for (auto& sender : partitions) {
+        auto& requests = sender.outbox[target_partition];
+        for (const auto& request : requests) {
+          if (request.distance >= tree.distances[request.target]) continue;
+          tree.distances[request.target] = request.distance;
+          tree.predecessors[request.target] = request.from;
+          tree.predecessor_edges[request.target] = request.edge;
+          enqueue(request.target, request.distance);
+        }
+        requests.clear();
+      }
+    };
+
+    tree.distances[src] = 0;
+    enqueue(src, 0);
+    auto slot_empty = [&partitions](std::size_t slot) {
+      return std::all_of(partitions.begin(), partitions.end(),
+                         [slot](const Partition& partition) { return partition.buckets[slot].empty(); });
+    };
+
+    while (true) {
+      std::size_t skipped = 0;
+      while (skipped < ring_size && slot_empty((current + skipped) % ring_size)) ++skipped;
+      if (skipped == ring_size) break;
+      current += skipped;
+      ++pass;
+      const auto slot = current % ring_size;
+
+      while (!slot_empty(slot)) {
+        pool.parallel_for(partition_count, [&](std::size_t index, std::size_t) {
+          auto& partition = partitions[index];
+          partition.frontier.clear();
+          partition.frontier.swap(partition.buckets[slot]);
+          for (const auto v : partition.frontier) {
+            if (queued_bucket[v] != current) continue;
+            queued_bucket[v] = kNotQueued;
+            if (settled_pass[v] != pass) {
+              settled_pass[v] = pass;
+              partition.settled.push_back(v);
+            }
+            emit(partition, v, true);
+          }
+        });
+        pool.parallel_for(partition_count, apply);
+      }
+
+      pool.parallel_for(partition_count, [&](std::size_t index, std::size_t) {
+        auto& partition = partitions[index];
+        for (const auto v : partition.settled) emit(partition, v, false);
+        partition.settled.clear();
+      });
+      // Heavy edges normally lead to later buckets; if one landed in the
+      // current bucket anyway, the next pass simply picks it up again
+      pool.parallel_for(partition_count, apply);
+    }
+    return tree;
+  }
+
+  ShortestPathTree shortest_path_tree(id_type src_node_id, cost_type bucket_width = 0) const {
+    ThreadPool pool;
+    return shortest_path_tree(src_node_id, pool, bucket_width);
+  }
+
+  // Preprocesses the current graph into a contraction hierarchy that answers
+  // the same point-to-point queries much faster. Like a snapshot, it does not
+  // see later changes to the graph.
+  BasicContractionHierarchy<Id, Cost> contraction_hierarchy() const {
+    using Hierarchy = BasicContractionHierarchy<Id, Cost>;
+    const auto& g = graph();
+    std::vector<id_type> vertex_ids;
+    std::vector<typename Hierarchy::Arc> arcs;
+    vertex_ids.reserve(g.vertex_count());
+    for (index_type v = 0; v < g.vertex_count(); ++v) {
+      vertex_ids.push_back(g.id_of(v));
+      for (const auto& edge : g.out_edges(v)) {
+        arcs.push_back(typename Hierarchy::Arc{v, edge.vertex, edge.edge_cost, edge.edge_id, Hierarchy::kNoArc,
+                                               Hierarchy::kNoArc});
+      }
+    }
+    return Hierarchy(std::move(vertex_ids), std::move(arcs));
+  }
+
+  // Same as above, reusing the caller's workspace for the search state.
+  template <typename Queue, typename Stats>
+  auto shortest_path(id_type src_node_id, id_type dest_node_id, BasicQueryWorkspace<Queue, Stats>& workspace,
+                     SearchMode mode = SearchMode::unidirectional) const {
+    const auto src = index_of(src_node_id);
+    const auto dest = index_of(dest_node_id);
+    QueryScope<BasicQueryWorkspace<Queue, Stats>> scope(workspace);
+
+    if (mode == SearchMode::bidirectional) {
+      index_type meeting_vertex = src;
+      if (!timed(workspace, &QueryCounters::search_time,
+                 [&] { return bidirectional_search(workspace, src, dest, meeting_vertex); })) {
+        throw std::runtime_error("No path found");
+      }
+      return timed(workspace, &QueryCounters::trace_time, [&] {
+        return trace_path(workspace.forward_, workspace.backward_, src, meeting_vertex, dest);
+      });
+    }
+
+    auto& space = workspace.forward_;
+    // Exception in case of not connected nodes
+    if (!timed(workspace, &QueryCounters::search_time, [&] { return search(space, src, dest); })) {
+      throw std::runtime_error("No path found");
+    }
+    return timed(workspace, &QueryCounters::trace_time, [&] { return trace_path(space, src, dest); });
+  }
+
+  // Cost of the shortest path, or nullopt when dest cannot be reached from
+  // src. The path itself is never traced. Unknown ids still throw.
+  std::optional<cost_type> shortest_distance(id_type src_node_id, id_type dest_node_id) const {
+    QueryWorkspace workspace;
+    return shortest_distance(src_node_id, dest_node_id, workspace);
+  }
+
+  template <typename Queue, typename Stats>
+  std::optional<cost_type> shortest_distance(id_type src_node_id, id_type dest_node_id,
+                                             BasicQueryWorkspace<Queue, Stats>& workspace,
+                                             SearchMode mode = SearchMode::unidirectional) const {
+    const auto src = index_of(src_node_id);
+    const auto dest = index_of(dest_node_id);
+    QueryScope<BasicQueryWorkspace<Queue, Stats>> scope(workspace);
+    return timed(workspace, &QueryCounters::search_time,
+                 [&] { return distance_between(workspace, src, dest, mode); });
+  }
+
+  // Non-throwing shortest_path(): fills nodes and edges (cleared first, their
+  // capacity reused) and reports the outcome as a status. With a warmed-up
+  // workspace and buffers a query allocates nothing.
+  PathStatus try_shortest_path(id_type src_node_id, id_type dest_node_id, std::vector<id_type>& nodes,
+                               std::vector<id_type>& edges) const {
+    QueryWorkspace workspace;
+    return try_shortest_path(src_node_id, dest_node_id, nodes, edges, workspace);
+  }
+
+  template <typename Queue, typename Stats>
+  PathStatus try_shortest_path(id_type src_node_id, id_type dest_node_id, std::vector<id_type>& nodes,
+                               std::vector<id_type>& edges, BasicQueryWorkspace<Queue, Stats>& workspace,
+                               SearchMode mode = SearchMode::unidirectional) const {
+    nodes.clear();
+    edges.clear();
+    index_type src = 0, dest = 0;
+    if (!graph().find_index(src_node_id, src) || !graph().find_index(dest_node_id, dest)) {
+      return PathStatus::invalid_vertex;
+    }
+    QueryScope<BasicQueryWorkspace<Queue, Stats>> scope(workspace);
+
+    if (mode == SearchMode::bidirectional) {
+      index_type meeting_vertex = src;
+      if (!timed(workspace, &QueryCounters::search_time,
+                 [&] { return bidirectional_search(workspace, src, dest, meeting_vertex); })) {
+        return PathStatus::no_path;
+      }
+      timed(workspace, &QueryCounters::trace_time, [&] {
+        append_path(workspace.forward_, workspace.backward_, src, meeting_vertex, dest, nodes, edges);
+      });
+      return PathStatus::found;
+    }
+
+    if (!timed(workspace, &QueryCounters::search_time, [&] { return search(workspace.forward_, src, dest); })) {
+      return PathStatus::no_path;
+    }
+    timed(workspace, &QueryCounters::trace_time,
+          [&] { append_path(workspace.forward_, src, dest, nodes, edges); });
+    return PathStatus::found;
+  }
+
+  // Cost from the nearest of sources to every vertex, from one multi-source
+  // search.
+  CostField cost_field(const std::vector<id_type>& sources) const {
+    QueryWorkspace workspace;
+    return cost_field(sources, workspace);
+  }
+
+  template <typename Queue, typename Stats>
+  CostField cost_field(const std::vector<id_type>& sources, BasicQueryWorkspace<Queue, Stats>& workspace) const {
+    return make_cost_field(sources, workspace, false);
+  }
+
+  // Cost from every vertex to the nearest of goals, from one search over the
+  // reverse graph: a planner can look up or descend the field from any
+  // vertex instead of querying once per start.
+  CostField cost_to_go(id_type goal) const { return cost_to_go(std::vector<id_type>{goal}); }
+
+  CostField cost_to_go(const std::vector<id_type>& goals) const {
+    QueryWorkspace workspace;
+    return cost_to_go(goals, workspace);
+  }
+
+  template <typename Queue, typename Stats>
+  CostField cost_to_go(const std::vector<id_type>& goals, BasicQueryWorkspace<Queue, Stats>& workspace) const {
+    return make_cost_field(goals, workspace, true);
+  }
+
+  // The k cheapest loopless paths from src to dest, cheapest first, by Yen's
+  // algorithm: every further path leaves one of the paths found so far at
+  // some spur vertex, keeping its root up to there. Each spur search runs
+  // in the same workspace and masks the graph logically, skipping the root's
+  // vertices and the edges by which paths with the same root already leave
+  // the spur. Fewer than k paths come back when no more exist, none when
+  // dest cannot be reached. Unknown ids throw.
+  std::vector<AlternativePath> k_shortest_paths(id_type src_node_id, id_type dest_node_id, std::size_t k) const {
+    QueryWorkspace workspace;
+    return k_shortest_paths(src_node_id, dest_node_id, k, workspace);
+  }
+
+  template <typename Queue, typename Stats>
+  std::vector<AlternativePath> k_shortest_paths(id_type src_node_id, id_type dest_node_id, std::size_t k,
+                                                BasicQueryWorkspace<Queue, Stats>& workspace) const {
+    const auto src = index_of(src_node_id);
+    const auto dest = index_of(dest_node_id);
+    std::vector<AlternativePath> paths;
+    if (k == 0) return paths;
+    QueryScope<BasicQueryWorkspace<Queue, Stats>> scope(workspace);
+    auto& space = workspace.forward_;
+
+    struct Route {
+      std::vector<index_type> vertices;
+      std::vector<id_type> edges;
+      std::vector<cost_type> costs; // Cost from src to each vertex
+    };
+    auto reaches_dest = [dest](index_type vertex) { return vertex == dest; };
+    // Appends the path spur -> dest of the last search to a route ending at spur
+    auto extend = [&](Route& route, index_type spur) {
+      const auto base = route.costs.back();
+      const auto first = route.vertices.size();
+      for (auto current = dest; current != spur; current = space.label(current).predecessor) {
+        route.vertices.push_back(current);
+        route.edges.push_back(space.label(current).edge_used);
+        route.costs.push_back(add_costs(base, space.distance(current)));
+      }
+      std::reverse(route.vertices.begin() + first, route.vertices.end());
+      std::reverse(route.edges.begin() + (first - 1), route.edges.end());
+      std::reverse(route.costs.begin() + first, route.costs.end());
+    };
+
+    std::vector<Route> accepted(1, Route{{src}, {}, {0}});
+    if (!timed(workspace, &QueryCounters::search_time, [&] { return search_until(space, src, reaches_dest); })) {
+      return paths;
+    }
+    timed(workspace, &QueryCounters::trace_time, [&] { extend(accepted.back(), src); });
+
+    std::vector<Route> candidates;
+    std::vector<index_type> root_vertices;
+    std::vector<id_type> banned_edges;
+    while (accepted.size() < k) {
+      const auto last = accepted.size() - 1;
+      for (std::size_t i = 0; i + 1 < accepted[last].vertices.size(); ++i) {
+        const auto& previous = accepted[last];
+        const auto spur = previous.vertices[i];
+        banned_edges.clear();
+        for (const auto& route : accepted) {
+          if (route.edges.size() > i && std::equal(previous.edges.begin(), previous.edges.begin() + i,
+                                                   route.edges.begin())) {
+            banned_edges.push_back(route.edges[i]);
+          }
+        }
+        root_vertices.assign(previous.vertices.begin(), previous.vertices.begin() + i);
+        std::sort(root_vertices.begin(), root_vertices.end());
+        auto usable = [&](const ConnectionListItem& edge) {
+          return !std::binary_search(root_vertices.begin(), root_vertices.end(), edge.vertex) &&
+                 std::find(banned_edges.begin(), banned_edges.end(), edge.edge_id) == banned_edges.end();
+        };
+        if (!timed(workspace, &QueryCounters::search_time,
+                   [&] { return search_until(space, spur, reaches_dest, false, usable); })) {
+          continue;
+        }
+
+        Route candidate{{previous.vertices.begin(), previous.vertices.begin() + i + 1},
+                        {previous.edges.begin(), previous.edges.begin() + i},
+                        {previous.costs.begin(), previous.costs.begin() + i + 1}};
+        timed(workspace, &QueryCounters::trace_time, [&] { extend(candidate, spur); });
+        const auto known = std::find_if(candidates.begin(), candidates.end(),
+                                        [&candidate](const Route& route) { return route.edges == candidate.edges; });
+        if (known == candidates.end()) candidates.push_back(std::move(candidate));
+      }
+      if (candidates.empty()) break;
+
+      // Cheapest candidate next; fewer hops, then edge ids break ties
+      auto best = std::min_element(candidates.begin(), candidates.end(), [](const Route& a, const Route& b) {
+        if (a.costs.back() != b.costs.back()) return a.costs.back() < b.costs.back();
+        if (a.edges.size() != b.edges.size()) return a.edges.size() < b.edges.size();
+        return a.edges < b.edges;
+      });
+      accepted.push_back(std::move(*best));
+      candidates.erase(best);
+    }
+
+    paths.reserve(accepted.size());
+    for (const auto& route : accepted) {
+      std::vector<id_type> nodes;
+      nodes.reserve(route.vertices.size());
+      for (const auto vertex : route.vertices) nodes.push_back(graph().id_of(vertex));
+      paths.push_back(AlternativePath{route.costs.back(), std::make_tuple(std::move(nodes), route.edges)});
+    }
+    return paths;
+  }
+
+  // Paths from src to the k nearest of targets, closest first, found by one
+  // search that stops as soon as the k-th distinct target is settled. Fewer
+  // than k entries come back when fewer targets are reachable. Unknown ids
+  // throw.
+  std::vector<TargetPath> nearest_targets(id_type src_node_id, const std::vector<id_type>& targets,
+                                          std::size_t k) const {
+    QueryWorkspace workspace;
+    return nearest_targets(src_node_id, targets, k, workspace);
+  }
+
+  template <typename Queue, typename Stats>
+  std::vector<TargetPath> nearest_targets(id_type src_node_id, const std::vector<id_type>& targets, std::size_t k,
+                                          BasicQueryWorkspace<Queue, Stats>& workspace) const {
+    const auto src = index_of(src_node_id);
+    // Sorted for a binary search per settled vertex, which stays cheap for
+    // small target sets on large graphs; repeated targets only count once
+    std::vector<index_type> target_indices;
+    target_indices.reserve(targets.size());
+    for (const auto target : targets) target_indices.push_back(index_of(target));
+    std::sort(target_indices.begin(), target_indices.end());
+    target_indices.erase(std::unique(target_indices.begin(), target_indices.end()), target_indices.end());
+
+    std::vector<TargetPath> found;
+    if (k == 0) return found;
+    QueryScope<BasicQueryWorkspace<Queue, Stats>> scope(workspace);
+    auto& space = workspace.forward_;
+    std::vector<index_type> hits;
+    timed(workspace, &QueryCounters::search_time, [&] {
+      search_until(space, src, [&](index_type vertex) {
+        if (!std::binary_search(target_indices.begin(), target_indices.end(), vertex)) return false;
+        hits.push_back(vertex);
+        return hits.size() == k;
+      });
+    });
+
+    // Settling order is distance order, and every hit keeps its label
+    timed(workspace, &QueryCounters::trace_time, [&] {
+      found.reserve(hits.size());
+      for (const auto hit : hits) {
+        found.push_back(TargetPath{graph().id_of(hit), space.distance(hit), trace_path(space, src, hit)});
+      }
+    });
+    return found;
+  }
+
+protected:
+  using typename Types::ConnectionListItem;
+  using typename Types::EdgeRange;
+  using typename Types::PriorityQueueItem;
+  using Types::add_costs;
+  using Types::kMaxBucketCount;
+
+  const Graph& graph() const { return static_cast<const Graph&>(*this); }
+
+  index_type index_of(id_type vertex_id) const {
+    index_type index = 0;
+    if (!graph().find_index(vertex_id, index)) {
+      throw std::runtime_error("Invalid vertex");
+    }
+    return index;
+  }
+
+  auto edges_of(index_type vertex, bool reverse) const {
+    return reverse ? graph().in_edges(vertex) : graph().out_edges(vertex);
+  }
+
+  // Search state of a workspace, for searches a Graph runs on its own.
+  template <typename Queue, typename Stats>
+  static auto& forward_space(BasicQueryWorkspace<Queue, Stats>& workspace) {
+    return workspace.forward_;
+  }
+
+  // Brackets one query for the stats policy of its workspace: clears the
+  // counters of the previous query and, on the way out, also when the query
+  // throws, adds the finished one to the workspace's aggregate.
+  template <typename Workspace>
+  class QueryScope {
+  public:
+    explicit QueryScope(Workspace& workspace) : workspace_(workspace) {
+      workspace_.forward_.stats().clear();
+      workspace_.backward_.stats().clear();
+    }
+
+    ~QueryScope() {
+      if constexpr (Workspace::stats_type::kEnabled) {
+        if (workspace_.aggregate_ != nullptr) workspace_.aggregate_->add(workspace_.stats());
+      }
+    }
+
+    QueryScope(const QueryScope&) = delete;
+    QueryScope& operator=(const QueryScope&) = delete;
+
+  private:
+    Workspace& workspace_;
+  };
+
+  // Searches from every origin at once, over the reverse graph for a
+  // cost-to-go field, and copies the labels of all vertices out.
+  template <typename Workspace>
+  CostField make_cost_field(const std::vector<id_type>& origins, Workspace& workspace, bool to_origins) const {
+    const auto& g = graph();
+    std::vector<index_type> origin_indices;
+    origin_indices.reserve(origins.size());
+    for (const auto origin : origins) origin_indices.push_back(index_of(origin));
+
+    QueryScope<Workspace> scope(workspace);
+    auto& space = workspace.forward_;
+    timed(workspace, &QueryCounters::search_time, [&] {
+      search_from(space, origin_indices, [](index_type) { return false; }, to_origins);
+    });
+
+    CostField field;
+    field.to_origins = to_origins;
+    const auto vertex_count = g.vertex_count();
+    field.vertex_ids.reserve(vertex_count);
+    field.costs.reserve(vertex_count);
+    field.next_edges.reserve(vertex_count);
+    field.next.reserve(vertex_count);
+    for (index_type v = 0; v < vertex_count; ++v) {
+      field.vertex_ids.push_back(g.id_of(v));
+      field.costs.push_back(space.distance(v));
+      const auto linked = space.reached(v) && space.label(v).predecessor != v;
+      field.next_edges.push_back(linked ? space.label(v).edge_used : kNoEdge);
+      field.next.push_back(linked ? space.label(v).predecessor : v);
+    }
+    return field;
+  }
+
+  // Runs one phase of a query and, with QueryStats, adds its duration to
+  // the given counter.
+  template <typename Workspace, typename Phase>
+  static decltype(auto) timed(Workspace& workspace, std::chrono::nanoseconds QueryCounters::*counter,
+                              Phase&& phase) {
+    if constexpr (Workspace::stats_type::kEnabled) {
+      struct Timer {
+        typename Workspace::stats_type& stats;
+        std::chrono::nanoseconds QueryCounters::*counter;
+        std::chrono::steady_clock::time_point start;
+        ~Timer() { stats.add_time(counter, std::chrono::steady_clock::now() - start); }
+      } timer{workspace.forward_.stats(), counter, std::chrono::steady_clock::now()};
+      return phase();
+    } else {
+      return phase();
+    }
+  }
+
+  // Runs Dijkstra from src until dest is settled, or until the whole
+  // component is exhausted. Returns whether dest was reached. A reverse
+  // search follows in_edges(), so it computes costs towards src.
+  template <typename Space>
+  bool search(Space& space, index_type src, index_type dest, bool reverse = false) const {
+    return search_until(space, src, [dest](index_type vertex) { return vertex == dest; }, reverse);
+  }
+
+  // Edge filter of the searches that may follow every edge.
+  struct AnyEdge {
+    bool operator()(const ConnectionListItem& /*edge*/) const { return true; }
+  };
+
+  // Same search, stopping as soon as stop(vertex) returns true for a newly
+  // settled vertex. Returns whether it stopped early. Edges for which
+  // usable(edge) is false are ignored, which masks parts of the graph
+  // without touching it.
+  template <typename Space, typename Stop, typename Usable = AnyEdge>
+  bool search_until(Space& space, index_type src, Stop&& stop, bool reverse = false, Usable usable = {}) const {
+    return search_from(space, std::array<index_type, 1>{src}, std::forward<Stop>(stop), reverse, usable);
+  }
+
+  // Same search grown from several origins at once, all queued at cost 0,
+  // so every vertex gets the cost from (or, reversed, to) its nearest origin.
+  template <typename Space, typename Origins, typename Stop, typename Usable = AnyEdge>
+  bool search_from(Space& space, const Origins& origins, Stop&& stop, bool reverse = false,
+                   Usable usable = {}) const {
+    space.reset(graph().vertex_count(), graph().max_edge_cost());
+    for (const auto origin : origins) {
+      auto& label = space.touch(origin);
+      if (label.distance == 0) continue; // Listed twice
+      label.distance = 0;
+      space.push(0, origin);
+    }
+
+    // Process the nodes
+    while (!space.queue_empty()) {
+      // Get the node with the smallest distance from the priority queue
+      auto [current_cost, current] = space.pop();
+      auto& current_label = space.touch(current);
+      // Skip visited
+      if (current_label.settled) {
+        space.stats().stale_pop();
+        continue;
+      }
+      current_label.settled = true;
+      space.stats().settled();
+      // Break in case to fullfill
+      if (stop(current)) return true;
+
+      for (const auto& edge : edges_of(current, reverse)) {
+        if (!usable(edge)) continue;
+        space.stats().relaxed();
+        auto& label = space.touch(edge.vertex);
+        if (label.settled) continue;
+        cost_type new_cost = add_costs(current_cost, edge.edge_cost);
+
+        // If this path is shorter, update the distance and save on the queue the destination node
+        if (new_cost < label.distance) {
+          label.distance = new_cost;
+          label.predecessor = current;
+          label.edge_used = edge.edge_id;
+          space.push(new_cost, edge.vertex);
+        }
+      }
+    }
+    return false;
+  }
+
+  // A* from src to dest: the queue is keyed by distance plus the estimate of
+  // the remaining cost. Vertices whose estimate is kUnreachable are pruned. A
+  // settled vertex is reopened when a cheaper path to it shows up, which only
+  // happens for inconsistent heuristics.
+  template <typename Estimate>
+  bool guided_search(SearchSpace& space, index_type src, index_type dest, Estimate& estimate) const {
+    const auto& g = graph();
+    space.reset(g.vertex_count(), g.max_edge_cost());
+    const auto src_estimate = estimate(src);
+    if (src_estimate == kUnreachable) return false;
+    space.touch(src).distance = 0;
+    space.push(src_estimate, src);
+
+    while (!space.queue_empty()) {
+      auto current = space.pop().second;
+      auto& current_label = space.touch(current);
+      if (current_label.settled) continue;
+      current_label.settled = true;
+      if (current == dest) return true;
+
+      const auto current_cost = current_label.distance;
+      for (const auto& edge : g.out_edges(current)) {
+        auto& label = space.touch(edge.vertex);
+        cost_type new_cost = add_costs(current_cost, edge.edge_cost);
+        if (new_cost < label.distance) {
+          const auto remaining = estimate(edge.vertex);
+          if (remaining == kUnreachable) continue;
+          label.distance = new_cost;
+          label.predecessor = current;
+          label.edge_used = edge.edge_id;
+          label.settled = false;
+          space.push(add_costs(new_cost, remaining), edge.vertex);
+        }
+      }
+    }
+    return false;
+  }
+
+  // Runs Dijkstra from src over out_edges() and from dest over in_edges(),
+  // always advancing the side whose queue holds the smaller key. Every time a
+  // vertex gets labelled by both sides it is a candidate meeting point; the
+  // search stops once the two queue minima add up to at least the best
+  // candidate, as no undiscovered path can be shorter than that sum.
+  template <typename Workspace>
+  bool bidirectional_search(Workspace& workspace, index_type src, index_type dest,
+                            index_type& meeting_vertex) const {
+    const auto& g = graph();
+    auto& forward = workspace.forward_;
+    auto& backward = workspace.backward_;
+    forward.reset(g.vertex_count(), g.max_edge_cost());
+    backward.reset(g.vertex_count(), g.max_edge_cost());
+    forward.touch(src).distance = 0;
+    forward.push(0, src);
+    backward.touch(dest).distance = 0;
+    backward.push(0, dest);
+
+    cost_type best = kUnreachable;
+    meeting_vertex = src;
+    if (src == dest) best = 0;
+
+    auto step = [&](auto& self, const auto& other, auto edges_of) {
+      auto [current_cost, current] = self.pop();
+      auto& current_label = self.touch(current);
+      if (current_label.settled) {
+        self.stats().stale_pop();
+        return;
+      }
+      current_label.settled = true;
+      self.stats().settled();
+
+      for (const auto& edge : edges_of(current)) {
+        self.stats().relaxed();
+        auto& label = self.touch(edge.vertex);
+        if (label.settled) continue;
+        cost_type new_cost = add_costs(current_cost, edge.edge_cost);
+        if (new_cost < label.distance) {
+          label.distance = new_cost;
+          label.predecessor = current;
+          label.edge_used = edge.edge_id;
+          self.push(new_cost, edge.vertex);
+
+          const auto other_cost = other.distance(edge.vertex);
+          if (other_cost != kUnreachable && add_costs(new_cost, other_cost) < best) {
+            best = add_costs(new_cost, other_cost);
+            meeting_vertex = edge.vertex;
+          }
+        }
+      }
+    };
+
+    while (!forward.queue_empty() && !backward.queue_empty()) {
+      const auto forward_min = forward.queue_min();
+      const auto backward_min = backward.queue_min();
+      if (best != kUnreachable && add_costs(forward_min, backward_min) >= best) break;
+
+      if (forward_min <= backward_min) {
+        step(forward, backward, [&g](index_type vertex) { return g.out_edges(vertex); });
+      } else {
+        step(backward, forward, [&g](index_type vertex) { return g.in_edges(vertex); });
+      }
+    }
+    return best != kUnreachable;
+  }
+
+  template <typename Workspace>
+  std::optional<cost_type> distance_between(Workspace& workspace, index_type src, index_type dest,
+                                            SearchMode mode) const {
+    if (mode == SearchMode::bidirectional) {
+      index_type meeting_vertex = src;
+      if (!bidirectional_search(workspace, src, dest, meeting_vertex)) return std::nullopt;
+      return add_costs(workspace.forward_.distance(meeting_vertex), workspace.backward_.distance(meeting_vertex));
+    }
+    if (!search(workspace.forward_, src, dest)) return std::nullopt;
+    return workspace.forward_.distance(dest);
+  }
+
+  // Appends the path src -> dest recorded by a finished search. The hop count
+  // is measured first so the ids are written straight into place from the
+  // back, with no reversal and at most one growth of each buffer.
+  template <typename Space>
+  void append_path(const Space& space, index_type src, index_type dest, std::vector<id_type>& nodes,
+                   std::vector<id_type>& edges) const {
+    std::size_t hops = 0;
+    for (auto current = dest; current != src; current = space.label(current).predecessor) ++hops;
+
+    const auto node_base = nodes.size();
+    const auto edge_base = edges.size();
+    nodes.resize(node_base + hops + 1);
+    edges.resize(edge_base + hops);
+    auto current = dest;
+    for (auto i = hops; i > 0; --i) {
+      const auto& label = space.label(current);
+      nodes[node_base + i] = graph().id_of(current);
+      edges[edge_base + i - 1] = label.edge_used;
+      current = label.predecessor;
+    }
+    nodes[node_base] = graph().id_of(src);
+  }
+
+  // Appends the forward half src -> meeting_vertex followed by the backward
+  // half meeting_vertex -> dest, whose predecessors point towards dest.
+  template <typename Space>
+  void append_path(const Space& forward, const Space& backward, index_type src, index_type meeting_vertex,
+                   index_type dest, std::vector<id_type>& nodes, std::vector<id_type>& edges) const {
+    append_path(forward, src, meeting_vertex, nodes, edges);
+    for (auto current = meeting_vertex; current != dest;) {
+      const auto& label = backward.label(current);
+      edges.push_back(label.edge_used);
+      current = label.predecessor;
+      nodes.push_back(graph().id_of(current));
+    }
+  }
+
+  // Trace back from the destination node to the source node through the
+  // predecessors recorded by a finished search.
+  template <typename Space>
+  std::tuple<std::vector<id_type>, std::vector<id_type>> trace_path(const Space& space, index_type src,
+                                                                     index_type dest) const {
+    std::vector<id_type> nodes, edges;
+    append_path(space, src, dest, nodes, edges);
+    // return the nodes (ids) and weights
+    return std::make_tuple(std::move(nodes), std::move(edges));
+  }
+
+  template <typename Space>
+  std::tuple<std::vector<id_type>, std::vector<id_type>> trace_path(const Space& forward,
+                                                                     const Space& backward, index_type src,
+                                                                     index_type meeting_vertex,
+                                                                     index_type dest) const {
+    std::vector<id_type> nodes, edges;
+    append_path(forward, backward, src, meeting_vertex, dest, nodes, edges);
+    return std::make_tuple(std::move(nodes), std::move(edges));
+  }
+};
+
+/// END EDIT --------------------------------------------------------
+
+// Editable graph. Id and Cost select the id and cost types, see
+// BasicShortestPathTypes; ShortestPathCalculator below uses std::size_t for both.
+template <typename Id, typename Cost>
+class BasicShortestPathCalculator : public ShortestPathQueries<BasicShortestPathCalculator<Id, Cost>, Id, Cost> {
+  using Queries = ShortestPathQueries<BasicShortestPathCalculator<Id, Cost>, Id, Cost>;
+
+public:
+  using typename Queries::id_type;
+  using typename Queries::cost_type;
+  using typename Queries::index_type;
+  using typename Queries::ShortestPathTree;
+  using Queries::kUnreachable;
+  using Queries::kNoEdge;
+
+  // Adds a vertex and returns its unique ID.
+  id_type add_vertex() {
+    auto id = make_id(); // Generate it
+    vertex_index_.emplace(id, vertex_ids_.size()); // Dense index for the query state
+    vertex_ids_.push_back(id);
+    graph_.emplace_back(); // Create an entry on the adjacency matrix
+    reverse_graph_.emplace_back();
+    return id;
+  }
+
+  // Adds a directed edge with a cost and returns its unique ID.
+  // Throws if either vertex doesn't exist or the cost is negative.
+  id_type add_edge(id_type from, id_type to, cost_type edge_cost) {
+    auto from_it = vertex_index_.find(from);
+    auto to_it = vertex_index_.find(to);
+    if (from_it == vertex_index_.end() || to_it == vertex_index_.end()) {
+      throw std::runtime_error("Invalid vertex"); // just in case
+    }
+    check_cost(edge_cost);
+    // Gen id
+
+    auto edge_id = make_id();
+
+    // Add the edge id
+
+    auto& out = graph_[from_it->second];
+    auto& in = reverse_graph_[to_it->second];
+    const EdgeLocation location{from_it->second, to_it->second, out.size(), in.size()};
+    out.push_back(ConnectionListItem{to_it->second, edge_id, edge_cost});
+    in.push_back(ConnectionListItem{from_it->second, edge_id, edge_cost});
+    edge_locations_.emplace(edge_id, location);
+    max_edge_cost_ = std::max(max_edge_cost_, edge_cost);
+    record_change(location, edge_id, false);
+    return edge_id;
+  }
+
+  // One edge of a bulk insertion.
+  struct EdgeSpec {
+    id_type from;
+    id_type to;
+    cost_type edge_cost;
+  };
+
+  // Makes room for vertex_count more vertices and edge_count more edges, so
+  // the per-vertex and per-edge lookup tables are not rehashed while loading.
+  void reserve(std::size_t vertex_count, std::size_t edge_count) {
+    const auto vertices = vertex_ids_.size() + vertex_count;
+    vertex_index_.reserve(vertices);
+    vertex_ids_.reserve(vertices);
+    graph_.reserve(vertices);
+    reverse_graph_.reserve(vertices);
+    edge_locations_.reserve(edge_locations_.size() + edge_count);
+  }
+
+  // Adds count vertices and returns their IDs, which are consecutive.
+  std::vector<id_type> add_vertices(std::size_t count) {
+    reserve(count, 0);
+    std::vector<id_type> ids;
+    ids.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) ids.push_back(add_vertex());
+    return ids;
+  }
+
+  // Adds a batch of edges and returns their IDs in the order given. Every
+  // endpoint is checked before anything changes, so an invalid vertex
+  // throws and leaves the graph untouched. Edges are counted per source and
+  // per destination first, which sizes each adjacency list exactly once.
+  std::vector<id_type> add_edges(const std::vector<EdgeSpec>& edges) {
+    std::vector<std::pair<index_type, index_type>> endpoints;
+    endpoints.reserve(edges.size());
+    for (const auto& edge : edges) {
+      auto from_it = vertex_index_.find(edge.from);
+      auto to_it = vertex_index_.find(edge.to);
+      if (from_it == vertex_index_.end() || to_it == vertex_index_.end()) {
+        throw std::runtime_error("Invalid vertex");
+      }
+      check_cost(edge.edge_cost);
+      endpoints.emplace_back(from_it->second, to_it->second);
+    }
+    check_ids_left(edges.size());
+
+    std::vector<std::size_t> out_count(graph_.size(), 0), in_count(graph_.size(), 0);
+    for (const auto& [from, to] : endpoints) {
+      ++out_count[from];
+      ++in_count[to];
+    }
+    for (index_type v = 0; v < graph_.size(); ++v) {
+      if (out_count[v] != 0) graph_[v].reserve(graph_[v].size() + out_count[v]);
+      if (in_count[v] != 0) reverse_graph_[v].reserve(reverse_graph_[v].size() + in_count[v]);
+    }
+    edge_locations_.reserve(edge_locations_.size() + edges.size());
+
+    std::vector<id_type> ids;
+    ids.reserve(edges.size());
+    for (std::size_t i = 0; i < edges.size(); ++i) {
+      const auto [from, to] = endpoints[i];
+      const auto edge_id = make_id();
+      const EdgeLocation location{from, to, graph_[from].size(), reverse_graph_[to].size()};
+      graph_[from].push_back(ConnectionListItem{to, edge_id, edges[i].edge_cost});
+      reverse_graph_[to].push_back(ConnectionListItem{from, edge_id, edges[i].edge_cost});
+      edge_locations_.emplace(edge_id, location);
+      max_edge_cost_ = std::max(max_edge_cost_, edges[i].edge_cost);
+      record_change(location, edge_id, false);
+      ids.push_back(edge_id);
+    }
+    return ids;
+  }
+
+  // Changes the cost of an existing edge. Throws if the edge doesn't exist or the
+  // cost is negative.
+  void update_edge_cost(id_type edge_id, cost_type edge_cost) {
+    const auto location = edge_location(edge_id);
+    check_cost(edge_cost);
+    auto& forward = graph_[location.from][location.out_position];
+    if (forward.edge_cost == edge_cost) return;
+    record_change(location, edge_id, edge_cost > forward.edge_cost);
+    forward.edge_cost = edge_cost;
+    reverse_graph_[location.to][location.in_position].edge_cost = edge_cost;
+    // Only ever raised, so it stays an upper bound for the bucket queues
+    max_edge_cost_ = std::max(max_edge_cost_, edge_cost);
+  }
+
+  // Removes an edge. Throws if the edge doesn't exist. The last edge of each
+  // adjacency list takes the freed slot, so removal is O(1).
+  void remove_edge(id_type edge_id) {
+    const auto location = edge_location(edge_id);
+    record_change(location, edge_id, true);
+    erase_connection(graph_[location.from], location.out_position, &EdgeLocation::out_position);
+    erase_connection(reverse_graph_[location.to], location.in_position, &EdgeLocation::in_position);
+    edge_locations_.erase(edge_id);
+  }
+
+  // Shortest path tree of src, kept across queries. The first call runs a
+  // full search; later calls first repair the tree for the edges added,
+  // changed or removed in the meantime, which only touches the vertices
+  // whose distance or predecessor is affected:
+  //  - a tree edge that got more expensive or was removed detaches the
+  //    subtree below it, whose vertices are re-seeded from their cheapest
+  //    incoming edge outside the subtree;
+  //  - a new or cheaper edge that now improves its target seeds that target;
+  //  - a Dijkstra pass from the seeds propagates the new distances.
+  // The reference stays valid until the cache is cleared.
+  const ShortestPathTree& cached_shortest_path_tree(id_type src_node_id) {
+    const auto src = index_of(src_node_id);
+    auto [it, inserted] = cached_trees_.try_emplace(src_node_id);
+    if (inserted) {
+      build_tree(it->second.tree, src);
+    } else {
+      repair_tree(it->second);
+    }
+    return it->second.tree;
+  }
+
+  // shortest_path() answered from the cached tree of src.
+  std::tuple<std::vector<id_type>, std::vector<id_type>> cached_shortest_path(id_type src_node_id,
+                                                                              id_type dest_node_id) {
+    return cached_shortest_path_tree(src_node_id).path(dest_node_id);
+  }
+
+  void clear_cached_trees() { cached_trees_.clear(); }
+
+  class Snapshot;
+
+  BasicShortestPathCalculator() = default;
+
+  // Rebuilds an editable graph from a snapshot, e.g. one loaded from disk.
+  // Vertex and edge ids are kept and new ones continue after them.
+  explicit BasicShortestPathCalculator(const Snapshot& snapshot);
+
+  // Compacts the current graph into an immutable compressed-sparse-row
+  // snapshot. Later changes to the calculator do not affect the snapshot.
+  Snapshot snapshot() const;
+
+  std::size_t vertex_count() const { return vertex_ids_.size(); }
+  cost_type max_edge_cost() const { return max_edge_cost_; }
+
+private:
+  friend Queries;
+
+  using typename Queries::ConnectionListItem;
+  using typename Queries::EdgeRange;
+  using typename Queries::PriorityQueueItem;
+  using typename Queries::SearchSpace;
+  using Queries::add_costs;
+  using Queries::valid_cost;
+  using Queries::index_of;
+  using Queries::search;
+
+  id_type id_{1}; // ID generator
+  std::unordered_map<id_type, index_type> vertex_index_; // Vertex ID -> dense index
+  std::vector<id_type> vertex_ids_;                       // Dense index -> vertex ID
+  std::vector<std::vector<ConnectionListItem>> graph_;    // Graph representation, by dense index
+  std::vector<std::vector<ConnectionListItem>> reverse_graph_; // Incoming edges, by dense index
+  cost_type max_edge_cost_{0};                            // Upper bound of every edge cost
+
+  // Where an edge is stored: its slot in the source's outgoing list and in
+  // the destination's incoming list.
+  struct EdgeLocation {
+    index_type from;
+    index_type to;
+    std::size_t out_position;
+    std::size_t in_position;
+  };
+
+  // An edge change a cached tree has not been repaired for yet.
+  struct EdgeChange {
+    id_type edge_id;
+    index_type from;
+    index_type to;
+    bool costlier; // Cost went up or the edge was removed
+  };
+
+  struct CachedTree {
+    ShortestPathTree tree;
+    std::vector<EdgeChange> pending;
+  };
+
+  std::unordered_map<id_type, EdgeLocation> edge_locations_; // Edge ID -> adjacency slots
+  std::unordered_map<id_type, CachedTree> cached_trees_;     // Source vertex ID -> tree
+
+  // Generates unique IDs.
+  id_type make_id() {
+    check_ids_left(1);
+    return id_++;
+  }
+
+  // The largest id is reserved for kNoEdge.
+  void check_ids_left(std::size_t count) const {
+    if (count > static_cast<std::size_t>(kNoEdge - id_)) {
+      throw std::overflow_error("Out of ids");
+    }
+  }
+
+  static void check_cost(cost_type edge_cost) {
+    if (!valid_cost(edge_cost)) {
+      throw std::runtime_error("Invalid cost");
+    }
+  }
+
+  const EdgeLocation& edge_location(id_type edge_id) const {
+    auto it = edge_locations_.find(edge_id);
+    if (it == edge_locations_.end()) {
+      throw std::runtime_error("Invalid edge");
+    }
+    return it->second;
+  }
+
+  void erase_connection(std::vector<ConnectionListItem>& connections, std::size_t position,
+                        std::size_t EdgeLocation::*slot) {
+    if (position + 1 != connections.size()) {
+      connections[position] = connections.back();
+      edge_locations_[connections[position].edge_id].*slot = position;
+    }
+    connections.pop_back();
+  }
+
+  void record_change(const EdgeLocation& location, id_type edge_id, bool costlier) {
+    for (auto& entry : cached_trees_) {
+      entry.second.pending.push_back(EdgeChange{edge_id, location.from, location.to, costlier});
+    }
+  }
+
+  void build_tree(ShortestPathTree& tree, index_type src) const {
+    SearchSpace space;
+    search(space, src, vertex_count());
+    tree.source = id_of(src);
+    tree.vertex_ids = vertex_ids_;
+    tree.distances.resize(vertex_count());
+    tree.predecessor_edges.resize(vertex_count());
+    tree.predecessors.resize(vertex_count());
+    for (index_type v = 0; v < vertex_count(); ++v) {
+      const bool reached = space.reached(v) && v != src;
+      tree.distances[v] = space.distance(v);
+      tree.predecessor_edges[v] = reached ? space.label(v).edge_used : kNoEdge;
+      tree.predecessors[v] = reached ? space.label(v).predecessor : v;
+    }
+  }
+
+  void repair_tree(CachedTree& cached) const {
+    auto& tree = cached.tree;
+    // Vertices added since the last repair start out unreachable
+    for (auto v = tree.vertex_ids.size(); v < vertex_count(); ++v) {
+      tree.vertex_ids.push_back(vertex_ids_[v]);
+      tree.distances.push_back(kUnreachable);
+      tree.predecessor_edges.push_back(kNoEdge);
+      tree.predecessors.push_back(v);
+    }
+    if (cached.pending.empty()) return;
+
+    auto& distances = tree.distances;
+    std::priority_queue<PriorityQueueItem, std::vector<PriorityQueueItem>, std::greater<PriorityQueueItem>> queue;
+    auto improve = [&](index_type vertex, cost_type distance, index_type from, id_type edge_id) {
+      distances[vertex] = distance;
+      tree.predecessors[vertex] = from;
+      tree.predecessor_edges[vertex] = edge_id;
+      queue.emplace(distance, vertex);
+    };
+
+    // Collect the detached subtrees, marking their vertices unreachable
+    std::vector<index_type> detached;
+    for (const auto& change : cached.pending) {
+      if (change.costlier && tree.predecessor_edges[change.to] == change.edge_id &&
+          distances[change.to] != kUnreachable) {
+        distances[change.to] = kUnreachable;
+        detached.push_back(change.to);
+      }
+    }
+    for (std::size_t i = 0; i < detached.size(); ++i) {
+      for (const auto& edge : out_edges(detached[i])) {
+        if (tree.predecessor_edges[edge.vertex] == edge.edge_id && distances[edge.vertex] != kUnreachable) {
+          distances[edge.vertex] = kUnreachable;
+          detached.push_back(edge.vertex);
+        }
+      }
+    }
+    for (const auto vertex : detached) {
+      tree.predecessors[vertex] = vertex;
+      tree.predecessor_edges[vertex] = kNoEdge;
+    }
+    for (const auto vertex : detached) {
+      for (const auto& edge : in_edges(vertex)) {
+        const auto from_distance = distances[edge.vertex];
+        const auto new_distance = add_costs(from_distance, edge.edge_cost);
+        if (from_distance != kUnreachable && new_distance < distances[vertex]) {
+          improve(vertex, new_distance, edge.vertex, edge.edge_id);
+        }
+      }
+    }
+
+    // Seed the targets of edges that may now offer a shortcut
+    for (const auto& change : cached.pending) {
+      auto it = edge_locations_.find(change.edge_id);
+      if (it == edge_locations_.end() || distances[change.from] == kUnreachable) continue;
+      const auto new_distance =
+          add_costs(distances[change.from], graph_[change.from][it->second.out_position].edge_cost);
+      if (new_distance < distances[change.to]) improve(change.to, new_distance, change.from, change.edge_id);
+    }
+    cached.pending.clear();
+
+    while (!queue.empty()) {
+      const auto [distance, current] = queue.top();
+      queue.pop();
+      if (distance > distances[current]) continue;
+      for (const auto& edge : out_edges(current)) {
+        const auto new_distance = add_costs(distance, edge.edge_cost);
+        if (new_distance < distances[edge.vertex]) {
+          improve(edge.vertex, new_distance, current, edge.edge_id);
+        }
+      }
+    }
+  }
+
+  bool find_index(id_type vertex_id, index_type& index) const {
+    auto it = vertex_index_.find(vertex_id);
+    if (it == vertex_index_.end()) return false;
+    index = it->second;
+    return true;
+  }
+
+  id_type id_of(index_type index) const { return vertex_ids_[index]; }
+
+  EdgeRange out_edges(index_type index) const {
+    const auto& connections = graph_[index];
+    return EdgeRange{connections.data(), connections.data() + connections.size()};
+  }
+
+  EdgeRange in_edges(index_type index) const {
+    const auto& connections = reverse_graph_[index];
+    return EdgeRange{connections.data(), connections.data() + connections.size()};
+  }
+};
+
+// Read-only copy of a ShortestPathCalculator graph stored in a compressed
+// sparse row layout: the outgoing edges of the vertex at index i live
+// contiguously in edges_[offsets_[i]] .. edges_[offsets_[i + 1]]. Queries never
+// chase per-vertex allocations, which pays off when a graph is built once and
+// queried many times.
+//
+// The same layout is the on-disk format of save() and load(), so a loaded
+// snapshot is memory-mapped and queried in place: its arrays are views into
+// whatever storage backs them, either vectors built by snapshot() or the
+// mapped file. Copies share that storage.
+template <typename Id, typename Cost>
+class BasicShortestPathCalculator<Id, Cost>::Snapshot
+    : public ShortestPathQueries<typename BasicShortestPathCalculator<Id, Cost>::Snapshot, Id, Cost> {
+  using Queries = ShortestPathQueries<Snapshot, Id, Cost>;
+
+public:
+  using typename Queries::id_type;
+  using typename Queries::cost_type;
+  using typename Queries::index_type;
+
+  Snapshot() { adopt(std::make_shared<const Arrays>()); }
+
+  std::size_t vertex_count() const { return vertex_ids_.size(); }
+  std::size_t edge_count() const { return edges_.size(); }
+  cost_type max_edge_cost() const { return max_edge_cost_; }
+
+  // File layout: this header, then vertex_ids_, offsets_, edges_,
+  // reverse_offsets_ and reverse_edges_, each padded to kAlignment bytes.
+  // Everything is in host byte order; byte_order tells a mismatch apart.
+  // Public so that tools can read a file without loading it.
+  struct FileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t id_size;
+    std::uint32_t cost_size;
+    std::uint32_t offset_size;
+    std::uint32_t edge_size;
+    std::uint32_t cost_kind; // Tells apart integer and floating point costs of the same size
+    std::uint32_t reserved;
+    std::uint64_t vertex_count;
+    std::uint64_t edge_count;
+    unsigned char max_edge_cost[8]; // A cost_type, zero padded
+    std::uint64_t next_id;
+  };
+
+  static constexpr std::size_t kAlignment = 8;
+
+  static constexpr std::size_t padded(std::size_t bytes) { return (bytes + kAlignment - 1) / kAlignment * kAlignment; }
+
+  // Writes the snapshot to path in the binary graph format.
+  void save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error("Cannot write " + path);
+    }
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(header.magic));
+    header.version = kFormatVersion;
+    header.byte_order = kByteOrderMark;
+    header.id_size = sizeof(id_type);
+    header.cost_size = sizeof(cost_type);
+    header.cost_kind = cost_kind();
+    header.offset_size = sizeof(std::size_t);
+    header.edge_size = sizeof(ConnectionListItem);
+    header.vertex_count = vertex_count();
+    header.edge_count = edge_count();
+    std::memcpy(header.max_edge_cost, &max_edge_cost_, sizeof(cost_type));
+    header.next_id = next_id_;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    auto write_section = [&out](const void* data, std::size_t bytes) {
+      static const char padding[kAlignment] = {};
+      out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+      out.write(padding, static_cast<std::streamsize>(padded(bytes) - bytes));
+    };
+    write_section(vertex_ids_.begin(), vertex_ids_.size() * sizeof(id_type));
+    write_section(offsets_.begin(), offsets_.size() * sizeof(std::size_t));
+    write_section(edges_.begin(), edges_.size() * sizeof(ConnectionListItem));
+    write_section(reverse_offsets_.begin(), reverse_offsets_.size() * sizeof(std::size_t));
+    write_section(reverse_edges_.begin(), reverse_edges_.size() * sizeof(ConnectionListItem));
+    if (!out.flush()) {
+      throw std::runtime_error("Cannot write " + path);
+    }
+  }
+
+  // Opens a file written by save(). The arrays are used where they lie,
+  // without copying, after one sequential pass checks that every offset,
+  // edge target and edge cost is in range and the vertex ids are sorted, so
+  // queries on a loaded snapshot never read outside it. Throws if the file
+  // is missing, truncated or inconsistent, or was written by another format
+  // version or a build with different id or cost types.
+  static Snapshot load(const std::string& path) {
+#ifdef KOAN_HAS_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat status {};
+    if (::fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(FileHeader)) {
+      ::close(fd);
+      throw std::runtime_error("Invalid graph file");
+    }
+    const auto size = static_cast<std::size_t>(status.st_size);
+    void* address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+      throw std::runtime_error("Cannot map " + path);
+    }
+    std::shared_ptr<const void> region(address, [size](const void* mapped) {
+      ::munmap(const_cast<void*>(mapped), size);
+    });
+#else
+    // No mmap: read the file into 8-byte aligned memory instead
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    const auto size = static_cast<std::size_t>(in.tellg());
+    auto buffer = std::make_shared<std::vector<std::uint64_t>>(padded(size) / sizeof(std::uint64_t));
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(buffer->data()), static_cast<std::streamsize>(size));
+    if (!in) {
+      throw std::runtime_error("Cannot read " + path);
+    }
+    std::shared_ptr<const void> region(buffer, buffer->data());
+#endif
+    return from_bytes(std::move(region), size);
+  }
+
+private:
+  friend class BasicShortestPathCalculator<Id, Cost>;
+  friend Queries;
+
+  using typename Queries::ConnectionListItem;
+  using typename Queries::EdgeRange;
+  using Queries::sorted_find_index;
+
+  // Read-only window on an array stored elsewhere.
+  template <typename T>
+  struct ArrayView {
+    const T* first{nullptr};
+    std::size_t count{0};
+    const T* begin() const { return first; }
+    const T* end() const { return first + count; }
+    std::size_t size() const { return count; }
+    const T& operator[](std::size_t i) const { return first[i]; }
+  };
+
+  // Backing storage of a snapshot built in memory.
+  struct Arrays {
+    std::vector<id_type> vertex_ids;
+    std::vector<std::size_t> offsets{0};
+    std::vector<ConnectionListItem> edges;
+    std::vector<std::size_t> reverse_offsets{0};
+    std::vector<ConnectionListItem> reverse_edges;
+  };
+
+  static constexpr char kMagic[8] = {'S', 'P', 'G', 'R', 'A', 'P', 'H', '\0'};
+  static constexpr std::uint32_t kFormatVersion = 2;
+  static constexpr std::uint32_t kByteOrderMark = 0x01020304;
+  static_assert(sizeof(FileHeader) % kAlignment == 0, "Sections must start aligned");
+  static_assert(alignof(ConnectionListItem) <= kAlignment, "Mapped edges must be aligned");
+  static_assert(sizeof(cost_type) <= sizeof(FileHeader::max_edge_cost), "Cost type too large for the header");
 
-//
-// This block may or may not be necessary depending on your implementation.
-// Feel free to use it if you need it, or delete it if you don't.
-// I selected to do it on the shortesPathCalculator class
-//
+  static constexpr std::uint32_t cost_kind() {
+    return std::is_floating_point_v<cost_type> ? 2 : std::is_signed_v<cost_type> ? 1 : 0;
+  }
 
-/// END EDIT --------------------------------------------------------
+  void adopt(std::shared_ptr<const Arrays> arrays) {
+    vertex_ids_ = {arrays->vertex_ids.data(), arrays->vertex_ids.size()};
+    offsets_ = {arrays->offsets.data(), arrays->offsets.size()};
+    edges_ = {arrays->edges.data(), arrays->edges.size()};
+    reverse_offsets_ = {arrays->reverse_offsets.data(), arrays->reverse_offsets.size()};
+    reverse_edges_ = {arrays->reverse_edges.data(), arrays->reverse_edges.size()};
+    storage_ = std::move(arrays);
+  }
+
+  static Snapshot from_bytes(std::shared_ptr<const void> region, std::size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(region.get());
+    FileHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kFormatVersion ||
+        header.byte_order != kByteOrderMark || header.id_size != sizeof(id_type) ||
+        header.cost_size != sizeof(cost_type) || header.cost_kind != cost_kind() ||
+        header.offset_size != sizeof(std::size_t) ||
+        header.edge_size != sizeof(ConnectionListItem)) {
+      throw std::runtime_error("Invalid graph file");
+    }
+
+    Snapshot result;
+    const auto vertex_count = static_cast<std::size_t>(header.vertex_count);
+    const auto edge_count = static_cast<std::size_t>(header.edge_count);
+    // Every section size is checked against the bytes left before it is
+    // multiplied out, so a huge count cannot wrap around
+    if (header.vertex_count >= size || header.edge_count >= size) {
+      throw std::runtime_error("Invalid graph file");
+    }
+    std::size_t position = sizeof(FileHeader);
+    auto section = [&](auto& view, std::size_t count) {
+      using T = std::remove_cv_t<std::remove_pointer_t<decltype(view.first)>>;
+      if (count > (size - position) / sizeof(T)) {
+        throw std::runtime_error("Invalid graph file");
+      }
+      view = {reinterpret_cast<const T*>(bytes + position), count};
+      position = std::min(size, position + padded(count * sizeof(T)));
+    };
+    section(result.vertex_ids_, vertex_count);
+    section(result.offsets_, vertex_count + 1);
+    section(result.edges_, edge_count);
+    section(result.reverse_offsets_, vertex_count + 1);
+    section(result.reverse_edges_, edge_count);
+    if (position != size) {
+      throw std::runtime_error("Invalid graph file");
+    }
+    std::memcpy(&result.max_edge_cost_, header.max_edge_cost, sizeof(cost_type));
+    result.validate();
+    result.next_id_ = static_cast<id_type>(header.next_id);
+    result.storage_ = std::move(region);
+    return result;
+  }
+
+  // Throws unless the arrays describe a graph the queries can walk safely:
+  // strictly increasing ids for the binary search, offsets running from 0 to
+  // edge_count without going back, targets below vertex_count, and costs in
+  // [0, max_edge_cost] for the bucket queues.
+  void validate() const {
+    const auto invalid = [] { throw std::runtime_error("Invalid graph file"); };
+    for (std::size_t v = 1; v < vertex_ids_.size(); ++v) {
+      if (!(vertex_ids_[v - 1] < vertex_ids_[v])) invalid();
+    }
+    const auto valid_cost = [this](cost_type cost) {
+      if constexpr (std::is_unsigned_v<cost_type>) {
+        return cost <= max_edge_cost_;
+      } else {
+        return cost >= 0 && cost <= max_edge_cost_; // Also false for NaN
+      }
+    };
+    if (!valid_cost(max_edge_cost_)) invalid();
+    const auto check_adjacency = [&](const ArrayView<std::size_t>& offsets,
+                                     const ArrayView<ConnectionListItem>& edges) {
+      if (offsets[0] != 0 || offsets[vertex_count()] != edges.size()) invalid();
+      for (std::size_t v = 0; v < vertex_count(); ++v) {
+        if (offsets[v + 1] < offsets[v]) invalid();
+      }
+      for (const auto& edge : edges) {
+        if (edge.vertex >= vertex_count() || !valid_cost(edge.edge_cost)) invalid();
+      }
+    };
+    check_adjacency(offsets_, edges_);
+    check_adjacency(reverse_offsets_, reverse_edges_);
+  }
+
+  bool find_index(id_type vertex_id, index_type& index) const {
+    return sorted_find_index(vertex_ids_, vertex_id, index);
+  }
+
+  id_type id_of(index_type index) const { return vertex_ids_[index]; }
+
+  EdgeRange out_edges(index_type index) const {
+    return EdgeRange{edges_.begin() + offsets_[index], edges_.begin() + offsets_[index + 1]};
+  }
+
+  EdgeRange in_edges(index_type index) const {
+    return EdgeRange{reverse_edges_.begin() + reverse_offsets_[index],
+                     reverse_edges_.begin() + reverse_offsets_[index + 1]};
+  }
+
+  std::shared_ptr<const void> storage_;             // Keeps the viewed arrays alive
+  ArrayView<id_type> vertex_ids_;                   // Dense index -> vertex ID
+  ArrayView<std::size_t> offsets_;                  // Edge range of each vertex, size V + 1
+  ArrayView<ConnectionListItem> edges_;             // Outgoing edges packed by source vertex
+  ArrayView<std::size_t> reverse_offsets_;          // Incoming edge range of each vertex, size V + 1
+  ArrayView<ConnectionListItem> reverse_edges_;     // Incoming edges packed by destination vertex
+  cost_type max_edge_cost_{0};
+  id_type next_id_{1};                              // First id the source calculator had not handed out
+};
+
+template <typename Id, typename Cost>
+typename BasicShortestPathCalculator<Id, Cost>::Snapshot BasicShortestPathCalculator<Id, Cost>::snapshot() const {
+  auto arrays = std::make_shared<typename Snapshot::Arrays>();
+  arrays->vertex_ids = vertex_ids_;
+
+  std::size_t edge_count = 0;
+  for (const auto& connections : graph_) edge_count += connections.size();
+
+  // Size every array exactly once, then copy each adjacency list in order
+  arrays->offsets.reserve(vertex_ids_.size() + 1);
+  arrays->edges.reserve(edge_count);
+  for (const auto& connections : graph_) {
+    arrays->edges.insert(arrays->edges.end(), connections.begin(), connections.end());
+    arrays->offsets.push_back(arrays->edges.size());
+  }
+  arrays->reverse_offsets.reserve(vertex_ids_.size() + 1);
+  arrays->reverse_edges.reserve(edge_count);
+  for (const auto& connections : reverse_graph_) {
+    arrays->reverse_edges.insert(arrays->reverse_edges.end(), connections.begin(), connections.end());
+    arrays->reverse_offsets.push_back(arrays->reverse_edges.size());
+  }
+
+  Snapshot result;
+  result.adopt(std::move(arrays));
+  result.max_edge_cost_ = max_edge_cost_;
+  result.next_id_ = id_;
+  return result;
+}
+
+template <typename Id, typename Cost>
+BasicShortestPathCalculator<Id, Cost>::BasicShortestPathCalculator(const Snapshot& snapshot)
+    : id_(snapshot.next_id_), vertex_ids_(snapshot.vertex_ids_.begin(), snapshot.vertex_ids_.end()),
+      graph_(snapshot.vertex_count()), reverse_graph_(snapshot.vertex_count()),
+      max_edge_cost_(snapshot.max_edge_cost_) {
+  vertex_index_.reserve(vertex_ids_.size());
+  edge_locations_.reserve(snapshot.edge_count());
+  for (index_type v = 0; v < vertex_ids_.size(); ++v) {
+    vertex_index_.emplace(vertex_ids_[v], v);
+    const auto out = snapshot.out_edges(v);
+    graph_[v].assign(out.begin(), out.end());
+    for (std::size_t position = 0; position < out.size(); ++position) {
+      edge_locations_.emplace(graph_[v][position].edge_id, EdgeLocation{v, graph_[v][position].vertex, position, 0});
+    }
+  }
+  for (index_type v = 0; v < vertex_ids_.size(); ++v) {
+    const auto in = snapshot.in_edges(v);
+    reverse_graph_[v].assign(in.begin(), in.end());
+    for (std::size_t position = 0; position < in.size(); ++position) {
+      edge_locations_[reverse_graph_[v][position].edge_id].in_position = position;
+    }
+  }
+}
+
+using ShortestPathCalculator = BasicShortestPathCalculator<std::size_t, std::size_t>;
 
-class ShortestPathCalculator {
+// Keeps answering queries while the graph is being updated. Writers stage
+// changes on a private ShortestPathCalculator and publish them in batches as
+// a new immutable Snapshot. The query methods read the current version through
+// a plain atomic pointer guarded by a hazard pointer: no lock and no reference
+// count is touched, and a writer only frees a replaced version once no query
+// has it announced. Up to 64 queries run at once; a further reader waits
+// for a slot. current() instead returns an owning shared_ptr, for
+// callers that keep a version across several queries; in libstdc++ the
+// atomic shared_ptr functions behind it take a lock from a global pool and
+// every call updates the shared reference count, so it is the slower path.
+template <typename Id, typename Cost>
+class BasicConcurrentShortestPathCalculator {
 public:
-  using id_type = std::size_t;    // Alias for node/edge IDs.
-  using cost_type = std::size_t; // Alias for edge costs.
+  using Calculator = BasicShortestPathCalculator<Id, Cost>;
+  using id_type = typename Calculator::id_type;
+  using cost_type = typename Calculator::cost_type;
+  using Version = std::shared_ptr<const typename Calculator::Snapshot>;
+
+  BasicConcurrentShortestPathCalculator() { publish(); }
+
+  explicit BasicConcurrentShortestPathCalculator(Calculator initial) : staging_(std::move(initial)) {
+    publish();
+  }
+
+  // Reader side ----------------------------------------------------------
+
+  // The latest published version of the graph. A version a reader holds
+  // stays alive and unchanged until the reader drops it.
+  Version current() const { return std::atomic_load_explicit(&current_, std::memory_order_acquire); }
+
+  // Number of publish() calls so far, including the initial version.
+  std::size_t version_count() const { return version_count_.load(std::memory_order_acquire); }
+
+  auto shortest_path(id_type src_node_id, id_type dest_node_id) const {
+    return read([&](const Snapshot& graph) { return graph.shortest_path(src_node_id, dest_node_id); });
+  }
+
+  auto shortest_path(id_type src_node_id, id_type dest_node_id,
+                     typename Calculator::QueryWorkspace& workspace) const {
+    return read(
+        [&](const Snapshot& graph) { return graph.shortest_path(src_node_id, dest_node_id, workspace); });
+  }
+
+  std::optional<cost_type> shortest_distance(id_type src_node_id, id_type dest_node_id,
+                                             typename Calculator::QueryWorkspace& workspace) const {
+    return read(
+        [&](const Snapshot& graph) { return graph.shortest_distance(src_node_id, dest_node_id, workspace); });
+  }
+
+  typename Calculator::PathStatus try_shortest_path(id_type src_node_id, id_type dest_node_id,
+                                                       std::vector<id_type>& nodes, std::vector<id_type>& edges,
+                                                       typename Calculator::QueryWorkspace& workspace) const {
+    return read([&](const Snapshot& graph) {
+      return graph.try_shortest_path(src_node_id, dest_node_id, nodes, edges, workspace);
+    });
+  }
+
+  std::vector<typename Calculator::AlternativePath> k_shortest_paths(id_type src_node_id, id_type dest_node_id,
+                                                                    std::size_t k,
+                                                                    typename Calculator::QueryWorkspace& workspace) const {
+    return read(
+        [&](const Snapshot& graph) { return graph.k_shortest_paths(src_node_id, dest_node_id, k, workspace); });
+  }
+
+  std::vector<typename Calculator::TargetPath> nearest_targets(id_type src_node_id,
+                                                               const std::vector<id_type>& targets, std::size_t k,
+                                                               typename Calculator::QueryWorkspace& workspace) const {
+    return read(
+        [&](const Snapshot& graph) { return graph.nearest_targets(src_node_id, targets, k, workspace); });
+  }
+
+  // Writer side ----------------------------------------------------------
+  // Writers are serialised among themselves. Staged changes only become
+  // visible to readers at the next publish().
 
-  // Adds a vertex and returns its unique ID.
   id_type add_vertex() {
-    auto id = make_id(); // Generate it
-    graph_.emplace(id, std::vector<ConnectionListItem>{}); // Create an entry on the adjacency matrix
-    return id;
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    return staging_.add_vertex();
   }
 
-  // Adds a directed edge with a cost and returns its unique ID.
-  // Throws if either vertex doesn't exist.
   id_type add_edge(id_type from, id_type to, cost_type edge_cost) {
-    if (graph_.find(from) == graph_.end() || graph_.find(to) == graph_.end()) {
-      throw std::runtime_error("Invalid vertex"); // just in case
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    return staging_.add_edge(from, to, edge_cost);
+  }
+
+  void update_edge_cost(id_type edge_id, cost_type edge_cost) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    staging_.update_edge_cost(edge_id, edge_cost);
+  }
+
+  void remove_edge(id_type edge_id) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    staging_.remove_edge(edge_id);
+  }
+
+  // Copies the staged graph into a new version and swaps it in for readers.
+  Version publish() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    return publish_locked();
+  }
+
+  // Applies batch(Calculator&) to the staged graph and publishes
+  // the result as a single version, so readers never see half a batch.
+  template <typename Batch>
+  Version update(Batch&& batch) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    std::forward<Batch>(batch)(staging_);
+    return publish_locked();
+  }
+
+private:
+  using Snapshot = typename Calculator::Snapshot;
+
+  static constexpr std::size_t kReaderSlots = 64;
+
+  struct alignas(64) ReaderSlot {
+    std::atomic<bool> owned{false};
+    std::atomic<const Snapshot*> version{nullptr};
+  };
+
+  // Runs query on the current version while a reader slot announces it.
+  template <typename Query>
+  auto read(Query&& query) const {
+    static thread_local const std::size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    ReaderSlot* slot = nullptr;
+    for (std::size_t attempt = 0; slot == nullptr; ++attempt) {
+      auto& candidate = readers_[(start + attempt) % kReaderSlots];
+      if (!candidate.owned.load(std::memory_order_relaxed) &&
+          !candidate.owned.exchange(true, std::memory_order_acquire)) {
+        slot = &candidate;
+      } else if (attempt % kReaderSlots == kReaderSlots - 1) {
+        std::this_thread::yield();
+      }
     }
-    // Gen id
-    
-    auto edge_id = make_id();
-    
-    // Add the edge id
+    struct Release {
+      ReaderSlot* slot;
+      ~Release() {
+        slot->version.store(nullptr, std::memory_order_release);
+        slot->owned.store(false, std::memory_order_release);
+      }
+    } release{slot};
 
-    graph_[from].emplace_back(ConnectionListItem{to, edge_id, edge_cost});
-    return edge_id;
+    // The announcement only protects the version if it is still current
+    // afterwards; publish_locked() scans the slots after swapping versions,
+    // and sequentially consistent operations on both sides guarantee that
+    // either this reload sees the new version or the scan sees the slot
+    auto* version = latest_.load(std::memory_order_seq_cst);
+    const Snapshot* announced = nullptr;
+    do {
+      announced = version;
+      slot->version.store(announced, std::memory_order_seq_cst);
+      version = latest_.load(std::memory_order_seq_cst);
+    } while (version != announced);
+    return std::forward<Query>(query)(*version);
   }
 
-  // Finds the shortest path from source to destination using Dijkstra's algorithm.
-  // I used this source: https://www.youtube.com/watch?v=bZkzH5x0SKU&ab_channel=FelixTechTips (great video)
-  // Returns a tuple of nodes and edges in the path to estimate the matrix
-  auto shortest_path(id_type src_node_id, id_type dest_node_id) const {
-    using PriorityQueueItem = std::pair<cost_type, id_type>; // Priority queue item: {cost, vertex ID}.
-    std::priority_queue<PriorityQueueItem, std::vector<PriorityQueueItem>, std::greater<>> pq;
-    
-    // Establish that the distance between the initial and the unknown is infinity
-    std::unordered_map<id_type, cost_type> distances;
-    std::unordered_map<id_type, id_type> predecessors, edge_used;
-    std::set<id_type> visited;
-    
-    // Set the source node distance as 0 and other still not visited as infinity 
-    for (const auto& [node_id, _] : graph_) distances[node_id] = std::numeric_limits<cost_type>::max();
-    distances[src_node_id] = 0;
-    pq.emplace(0, src_node_id);
-    
-    // Process the nodes 
-    while (!pq.empty()) {
-      // Get the node with the smallest distance from the priority queue 
-      auto [current_cost, current_node] = pq.top();
-      pq.pop();
-      // Skip visited
-      if (visited.count(current_node)) continue;
-      visited.insert(current_node);
-      // Break in case to fullfill
-      if (current_node == dest_node_id) break;
+  Version publish_locked() {
+    auto version = std::make_shared<const Snapshot>(staging_.snapshot());
+    std::atomic_store_explicit(&current_, version, std::memory_order_release);
+    latest_.store(version.get(), std::memory_order_seq_cst);
+    if (latest_version_) retired_.push_back(std::move(latest_version_));
+    latest_version_ = version;
+    version_count_.fetch_add(1, std::memory_order_acq_rel);
 
-      for (const auto& edge : graph_.at(current_node)) {
-        if (visited.count(edge.dst_vertex_id)) continue;
-        cost_type new_cost = current_cost + edge.edge_cost;
-        
-        // If this path is shorter, update the distance and save on the queue the destination node
-        if (new_cost < distances[edge.dst_vertex_id]) {
-          distances[edge.dst_vertex_id] = new_cost;
-          predecessors[edge.dst_vertex_id] = current_node;
-          edge_used[edge.dst_vertex_id] = edge.edge_id;
-          pq.emplace(new_cost, edge.dst_vertex_id);
-        }
+    // Drop our reference to every replaced version no reader has announced;
+    // one held through current() lives on until its holder lets go
+    std::vector<const Snapshot*> announced;
+    for (const auto& slot : readers_) {
+      if (const auto* in_use = slot.version.load(std::memory_order_seq_cst)) announced.push_back(in_use);
+    }
+    retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                  [&](const Version& old) {
+                                    return std::find(announced.begin(), announced.end(), old.get()) ==
+                                           announced.end();
+                                  }),
+                   retired_.end());
+    return version;
+  }
+
+  std::mutex writer_mutex_;
+  Calculator staging_; // Writer-private, guarded by writer_mutex_
+  Version current_;                // Accessed with atomic shared_ptr operations only
+  std::atomic<const Snapshot*> latest_{nullptr}; // Same version as current_, for read()
+  mutable std::array<ReaderSlot, kReaderSlots> readers_;
+  // Writer-private, guarded by writer_mutex_: keep latest_ and the replaced
+  // versions readers may still be querying alive
+  Version latest_version_;
+  std::vector<Version> retired_;
+  std::atomic<std::size_t> version_count_{0};
+};
+
+using ConcurrentShortestPathCalculator = BasicConcurrentShortestPathCalculator<std::size_t, std::size_t>;
+
+// Answers shortest path requests from many client threads on a fixed set of
+// worker threads that share one read-only snapshot. Requests wait in a
+// bounded lock-free queue. A worker takes up to max_batch of them at once and
+// runs a single search for all requests with the same source, stopping once
+// every destination among them is settled. Each request gets its result
+// through a std::future, which returns the path or rethrows the error that
+// shortest_path() would have thrown.
+template <typename Id, typename Cost>
+class BasicShortestPathService {
+public:
+  using Calculator = BasicShortestPathCalculator<Id, Cost>;
+  using id_type = typename Calculator::id_type;
+  using Graph = std::shared_ptr<const typename Calculator::Snapshot>;
+  using Path = std::tuple<std::vector<id_type>, std::vector<id_type>>;
+
+  explicit BasicShortestPathService(Graph graph,
+                                    std::size_t worker_count = std::thread::hardware_concurrency(),
+                                    std::size_t queue_capacity = 1024, std::size_t max_batch = 32)
+      : graph_(std::move(graph)), queue_(queue_capacity), max_batch_(std::max<std::size_t>(max_batch, 1)) {
+    if (!graph_) {
+      throw std::runtime_error("Missing graph");
+    }
+    worker_count = std::max<std::size_t>(worker_count, 1);
+    for (std::size_t worker = 0; worker < worker_count; ++worker) {
+      workers_.emplace_back([this] { work(); });
+    }
+  }
+
+  BasicShortestPathService(const BasicShortestPathService&) = delete;
+  BasicShortestPathService& operator=(const BasicShortestPathService&) = delete;
+
+  // Requests still queued are answered before the workers exit.
+  ~BasicShortestPathService() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) worker.join();
+  }
+
+  const Graph& graph() const { return graph_; }
+  std::size_t worker_count() const { return workers_.size(); }
+
+  // Requests the workers have taken on so far, and the searches it took to
+  // answer them.
+  std::size_t handled() const { return handled_.load(std::memory_order_relaxed); }
+  std::size_t searches() const { return searches_.load(std::memory_order_relaxed); }
+
+  // Queues a request, yielding while the queue is full so that fast clients
+  // are slowed down to the rate the workers can sustain.
+  std::future<Path> submit(id_type src_node_id, id_type dest_node_id) {
+    Request request{src_node_id, dest_node_id, {}};
+    auto result = request.result.get_future();
+    pending_.fetch_add(1);
+    while (!queue_.try_push(request)) std::this_thread::yield();
+    wake_sleeper();
+    return result;
+  }
+
+  // Queues a request unless the queue is full, for clients that would rather
+  // shed load than wait.
+  std::optional<std::future<Path>> try_submit(id_type src_node_id, id_type dest_node_id) {
+    Request request{src_node_id, dest_node_id, {}};
+    auto result = request.result.get_future();
+    pending_.fetch_add(1);
+    if (!queue_.try_push(request)) {
+      pending_.fetch_sub(1);
+      return std::nullopt;
+    }
+    wake_sleeper();
+    return result;
+  }
+
+private:
+  struct Request {
+    id_type src{};
+    id_type dest{};
+    std::promise<Path> result;
+  };
+
+  // Clients count a request in pending_ before pushing it, so the worker
+  // that takes it always decrements after that increment and the count never
+  // drops below the number of queued requests; it may briefly exceed it while
+  // a push is under way. A worker only goes to sleep after registering in
+  // sleeping_ and then seeing pending_ at zero, and a client only skips the
+  // wake-up after pushing and then seeing no sleeper. Both sides use
+  // sequentially consistent operations, so at least one of them sees the
+  // other and no request is left waiting next to a sleeping worker.
+  void wake_sleeper() {
+    if (sleeping_.load() > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wake_.notify_one();
+    }
+  }
+
+  bool take(Request& request) {
+    if (!queue_.try_pop(request)) return false;
+    pending_.fetch_sub(1);
+    return true;
+  }
+
+  // Waits for the next request; false once the service stops and the queue
+  // has drained.
+  bool next_request(Request& request) {
+    for (int spin = 0; spin < 64; ++spin) {
+      if (take(request)) return true;
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (take(request)) return true;
+      if (pending_.load() > 0) {
+        // Counted but not pushed yet, or just taken by another worker that
+        // has not uncounted it: let that thread finish without the lock
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+        continue;
       }
+      if (stopping_) return false;
+      sleeping_.fetch_add(1);
+      wake_.wait(lock, [this] { return stopping_ || pending_.load() > 0; });
+      sleeping_.fetch_sub(1);
     }
-    // Exception in case of not connected nodes
-    
-    if (distances[dest_node_id] == std::numeric_limits<cost_type>::max()) {
-      throw std::runtime_error("No path found");
+  }
+
+  void work() {
+    typename Calculator::QueryWorkspace workspace;
+    std::vector<Request> batch;
+    batch.reserve(max_batch_);
+    Request request;
+    while (next_request(request)) {
+      batch.push_back(std::move(request));
+      while (batch.size() < max_batch_ && take(request)) batch.push_back(std::move(request));
+      // Counted before any future becomes ready, so a client that holds all
+      // of its answers also sees them in handled()
+      handled_.fetch_add(batch.size(), std::memory_order_relaxed);
+      std::stable_sort(batch.begin(), batch.end(),
+                       [](const Request& a, const Request& b) { return a.src < b.src; });
+      for (auto first = batch.begin(); first != batch.end();) {
+        const auto src = first->src;
+        const auto last = std::find_if(first, batch.end(), [src](const Request& r) { return r.src != src; });
+        answer(first, last, workspace);
+        first = last;
+      }
+      batch.clear();
     }
+  }
 
-    // Trace back from the destination node to the source node
-    
-    std::vector<id_type> nodes, edges;
-    for (id_type current = dest_node_id; current != src_node_id; current = predecessors[current]) {
-      nodes.push_back(current);
-      edges.push_back(edge_used[current]);
+  // Answers requests [first, last), which all share their source.
+  template <typename Iterator>
+  void answer(Iterator first, Iterator last, typename Calculator::QueryWorkspace& workspace) {
+    const auto& graph = *graph_;
+    std::vector<Request*> valid;
+    std::vector<id_type> targets;
+    for (auto request = first; request != last; ++request) {
+      if (graph.has_vertex(request->src) && graph.has_vertex(request->dest)) {
+        valid.push_back(&*request);
+        targets.push_back(request->dest);
+      } else {
+        request->result.set_exception(std::make_exception_ptr(std::runtime_error("Invalid vertex")));
+      }
     }
-    nodes.push_back(src_node_id);
+    if (valid.empty()) return;
+    // nearest_targets() counts distinct targets towards k
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
 
-    // Reverse the order of nodes and edges to start from the source
-    std::reverse(nodes.begin(), nodes.end());
-    std::reverse(edges.begin(), edges.end());
+    try {
+      auto found = graph.nearest_targets(valid.front()->src, targets, targets.size(), workspace);
+      searches_.fetch_add(1, std::memory_order_relaxed);
+      for (auto* request : valid) {
+        const auto hit = std::find_if(found.begin(), found.end(),
+                                      [request](const auto& target) { return target.target == request->dest; });
+        if (hit == found.end()) {
+          request->result.set_exception(std::make_exception_ptr(std::runtime_error("No path found")));
+        } else {
+          request->result.set_value(hit->path);
+        }
+      }
+    } catch (...) {
+      // Nothing has been answered yet: the search itself failed
+      for (auto* request : valid) request->result.set_exception(std::current_exception());
+    }
+  }
 
-    // return the nodes (ids) and weights
-    return std::make_tuple(nodes, edges);
+  Graph graph_;
+  BoundedMpmcQueue<Request> queue_;
+  std::size_t max_batch_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_; // Only taken to sleep, to wake a sleeper or to stop
+  std::condition_variable wake_;
+  bool stopping_{false};
+  std::atomic<std::size_t> pending_{0};  // Requests counted by clients and not yet taken
+  std::atomic<std::size_t> sleeping_{0}; // Workers waiting on wake_
+  std::atomic<std::size_t> handled_{0};
+  std::atomic<std::size_t> searches_{0};
+};
+
+using ShortestPathService = BasicShortestPathService<std::size_t, std::size_t>;
+
+// 2D occupancy grid queried as a graph without storing any edges. Every cell
+// is a vertex whose id is its row-major index y * width + x; free cells link
+// to their free 8-neighbours, straight steps costing cell_size and diagonal
+// steps cell_size * sqrt(2). A diagonal step needs both cells it passes
+// between to be free, so paths never cut a blocked corner. Edge ids are
+// computed as well: the edge leaving cell c in direction d is c * 8 + d.
+//
+// The occupancy is stored twice as packed bits, once by rows and once by
+// columns, which is all the memory the graph takes. Besides the shared
+// queries, jump_point_path() runs Jump Point Search, which skips the
+// symmetric runs of cells in between jump points; the straight scans look at
+// 64 cells per step by testing whole words of the bit rows and columns.
+template <typename Id, typename Cost>
+class BasicOccupancyGrid : public ShortestPathQueries<BasicOccupancyGrid<Id, Cost>, Id, Cost> {
+  using Queries = ShortestPathQueries<BasicOccupancyGrid<Id, Cost>, Id, Cost>;
+
+public:
+  static_assert(std::is_floating_point_v<Cost>, "Grid steps cost octile distances");
+
+  using typename Queries::id_type;
+  using typename Queries::cost_type;
+  using typename Queries::index_type;
+  using typename Queries::QueryWorkspace;
+  using Queries::kUnreachable;
+  using Queries::kNoEdge;
+
+  // Creates a width x height grid with every cell free.
+  BasicOccupancyGrid(std::size_t width, std::size_t height, cost_type cell_size = 1)
+      : width_(width), height_(height), straight_cost_(cell_size),
+        diagonal_cost_(cell_size * static_cast<cost_type>(1.4142135623730951)), rows_(height, width),
+        columns_(width, height) {
+    if (!Queries::valid_cost(cell_size) || !(cell_size > 0)) {
+      throw std::runtime_error("Invalid cost");
+    }
+    // Edge ids go up to vertex_count() * 8 and the largest id is kNoEdge
+    if (height != 0 && width > static_cast<std::size_t>(kNoEdge) / 8 / height) {
+      throw std::overflow_error("Grid too large for its id type");
+    }
+    for (std::size_t y = 0; y < height; ++y) {
+      for (std::size_t x = 0; x < width; ++x) {
+        rows_.set(y, x, true);
+        columns_.set(x, y, true);
+      }
+    }
+  }
+
+  std::size_t width() const { return width_; }
+  std::size_t height() const { return height_; }
+
+  id_type cell_id(std::size_t x, std::size_t y) const {
+    check_cell(x, y);
+    return static_cast<id_type>(y * width_ + x);
+  }
+
+  // {x, y} of a cell id.
+  std::pair<std::size_t, std::size_t> cell_of(id_type cell) const {
+    const auto index = this->index_of(cell);
+    return {index % width_, index / width_};
+  }
+
+  bool blocked(std::size_t x, std::size_t y) const {
+    check_cell(x, y);
+    return !rows_.get(y, x);
+  }
+
+  void set_blocked(std::size_t x, std::size_t y, bool blocked = true) {
+    check_cell(x, y);
+    rows_.set(y, x, !blocked);
+    columns_.set(x, y, !blocked);
+  }
+
+  cost_type edge_cost(id_type edge_id) const { return edge_id % 8 < 4 ? straight_cost_ : diagonal_cost_; }
+
+  // Cost of the cheapest path between two cells if nothing was blocked. It
+  // never overestimates, so it can guide the A* overloads of shortest_path().
+  cost_type octile_distance(id_type from, id_type to) const {
+    return cell_distance(this->index_of(from), this->index_of(to));
+  }
+
+  // A shortest path from src to dest with the same cost as shortest_path(),
+  // as the full cell-by-cell path with its edge ids, found by Jump Point
+  // Search. Where several paths tie, the two may return different ones.
+  // Throws when there is no path.
+  auto jump_point_path(id_type src_node_id, id_type dest_node_id) const {
+    QueryWorkspace workspace;
+    return jump_point_path(src_node_id, dest_node_id, workspace);
+  }
+
+  auto jump_point_path(id_type src_node_id, id_type dest_node_id, QueryWorkspace& workspace) const {
+    const auto src = this->index_of(src_node_id);
+    const auto dest = this->index_of(dest_node_id);
+    auto& space = Queries::forward_space(workspace);
+    if (!jump_point_search(space, src, dest)) {
+      throw std::runtime_error("No path found");
+    }
+
+    // Jump points from dest back to src, then every cell in between
+    std::vector<index_type> jump_points;
+    for (auto current = dest; current != src; current = space.label(current).predecessor) {
+      jump_points.push_back(current);
+    }
+    std::vector<id_type> nodes{src}, edges;
+    for (auto current = src; !jump_points.empty(); jump_points.pop_back()) {
+      const auto next = jump_points.back();
+      const auto dx = sign(column(next) - column(current));
+      const auto dy = sign(row(next) - row(current));
+      const auto direction = direction_of(dx, dy);
+      while (current != next) {
+        edges.push_back(static_cast<id_type>(current * std::size_t{8} + direction));
+        current = static_cast<index_type>(current + dy * static_cast<std::ptrdiff_t>(width_) + dx);
+        nodes.push_back(current);
+      }
+    }
+    return std::make_tuple(std::move(nodes), std::move(edges));
   }
 
+  std::size_t vertex_count() const { return width_ * height_; }
+  cost_type max_edge_cost() const { return diagonal_cost_; }
+
 private:
-  struct ConnectionListItem {
-    id_type dst_vertex_id; // Destination vertex
-    id_type edge_id;       // Edge ID
-    cost_type edge_cost;   // Edge cost
+  friend Queries;
+
+  using typename Queries::ConnectionListItem;
+  using typename Queries::SearchSpace;
+  using Queries::add_costs;
+
+  // One bit per cell, set when the cell is free, packed along lines (rows or
+  // columns). Bits past the end of a line stay clear, so cells outside the
+  // grid read as blocked.
+  class BitLines {
+  public:
+    BitLines(std::size_t line_count, std::size_t line_length)
+        : line_count_(line_count), words_per_line_((line_length + 63) / 64),
+          bits_(line_count * words_per_line_, 0) {}
+
+    bool get(std::ptrdiff_t line, std::ptrdiff_t position) const { return window(line, position) & 1; }
+
+    void set(std::size_t line, std::size_t position, bool value) {
+      auto& word = bits_[line * words_per_line_ + position / 64];
+      const auto bit = std::uint64_t{1} << (position % 64);
+      word = value ? word | bit : word & ~bit;
+    }
+
+    // Bits of the 64 cells starting at position, lowest bit first.
+    std::uint64_t window(std::ptrdiff_t line, std::ptrdiff_t position) const {
+      if (line < 0 || line >= static_cast<std::ptrdiff_t>(line_count_)) return 0;
+      const auto word = position >= 0 ? position / 64 : -((63 - position) / 64);
+      const auto shift = static_cast<unsigned>(position - word * 64);
+      auto bits = word_at(line, word) >> shift;
+      if (shift != 0) bits |= word_at(line, word + 1) << (64 - shift);
+      return bits;
+    }
+
+  private:
+    std::uint64_t word_at(std::ptrdiff_t line, std::ptrdiff_t word) const {
+      if (word < 0 || word >= static_cast<std::ptrdiff_t>(words_per_line_)) return 0;
+      return bits_[static_cast<std::size_t>(line) * words_per_line_ + static_cast<std::size_t>(word)];
+    }
+
+    std::size_t line_count_;
+    std::size_t words_per_line_;
+    std::vector<std::uint64_t> bits_;
   };
 
-  std::size_t id_{1}; // ID generator
-  std::unordered_map<id_type, std::vector<ConnectionListItem>> graph_; // Graph representation
+  // Neighbours of one cell, generated on demand.
+  struct NeighbourRange {
+    std::array<ConnectionListItem, 8> items;
+    std::size_t count{0};
+    const ConnectionListItem* begin() const { return items.data(); }
+    const ConnectionListItem* end() const { return items.data() + count; }
+    std::size_t size() const { return count; }
+  };
 
-  // Generates unique IDs.
-  std::size_t make_id() { return id_++; }
+  // Step of each direction; edge ids encode the direction as this index, the
+  // four straight ones first.
+  static constexpr std::array<std::array<int, 2>, 8> kSteps{
+      {{1, 0}, {0, 1}, {-1, 0}, {0, -1}, {1, 1}, {-1, 1}, {-1, -1}, {1, -1}}};
+
+  std::size_t width_;
+  std::size_t height_;
+  cost_type straight_cost_;
+  cost_type diagonal_cost_;
+  BitLines rows_;    // Line y holds row y
+  BitLines columns_; // Line x holds column x
+
+  void check_cell(std::size_t x, std::size_t y) const {
+    if (x >= width_ || y >= height_) {
+      throw std::out_of_range("Cell outside the grid");
+    }
+  }
+
+  static int sign(std::ptrdiff_t value) { return (value > 0) - (value < 0); }
+
+  static std::size_t direction_of(int dx, int dy) {
+    std::size_t direction = 0;
+    while (kSteps[direction][0] != dx || kSteps[direction][1] != dy) ++direction;
+    return direction;
+  }
+
+  std::ptrdiff_t column(index_type index) const { return static_cast<std::ptrdiff_t>(index % width_); }
+  std::ptrdiff_t row(index_type index) const { return static_cast<std::ptrdiff_t>(index / width_); }
+
+  index_type index_at(std::ptrdiff_t x, std::ptrdiff_t y) const {
+    return static_cast<index_type>(static_cast<std::size_t>(y) * width_ + static_cast<std::size_t>(x));
+  }
+
+  bool passable(std::ptrdiff_t x, std::ptrdiff_t y) const { return rows_.get(y, x); }
+
+  // A step from (x, y) by (dx, dy) onto a free cell, not cutting a corner.
+  bool can_step(std::ptrdiff_t x, std::ptrdiff_t y, int dx, int dy) const {
+    return passable(x + dx, y + dy) && (dx == 0 || dy == 0 || (passable(x + dx, y) && passable(x, y + dy)));
+  }
+
+  cost_type cell_distance(index_type from, index_type to) const {
+    const auto dx = static_cast<cost_type>(std::abs(column(to) - column(from)));
+    const auto dy = static_cast<cost_type>(std::abs(row(to) - row(from)));
+    return std::max(dx, dy) * straight_cost_ + std::min(dx, dy) * (diagonal_cost_ - straight_cost_);
+  }
+
+  bool find_index(id_type vertex_id, index_type& index) const {
+    if (vertex_id >= vertex_count()) return false;
+    index = vertex_id;
+    return true;
+  }
+
+  id_type id_of(index_type index) const { return index; }
+
+  NeighbourRange out_edges(index_type index) const {
+    NeighbourRange range;
+    const auto x = column(index), y = row(index);
+    if (!passable(x, y)) return range;
+    for (std::size_t direction = 0; direction < kSteps.size(); ++direction) {
+      const auto [dx, dy] = kSteps[direction];
+      if (!can_step(x, y, dx, dy)) continue;
+      range.items[range.count++] = ConnectionListItem{index_at(x + dx, y + dy),
+                                                      static_cast<id_type>(index * std::size_t{8} + direction),
+                                                      direction < 4 ? straight_cost_ : diagonal_cost_};
+    }
+    return range;
+  }
+
+  // Steps are symmetric, so the edges into a cell come from the cells its
+  // own edges lead to.
+  NeighbourRange in_edges(index_type index) const {
+    NeighbourRange range;
+    const auto x = column(index), y = row(index);
+    if (!passable(x, y)) return range;
+    for (std::size_t direction = 0; direction < kSteps.size(); ++direction) {
+      const auto [dx, dy] = kSteps[direction];
+      if (!can_step(x, y, -dx, -dy)) continue;
+      const auto from = index_at(x - dx, y - dy);
+      range.items[range.count++] = ConnectionListItem{from, static_cast<id_type>(from * std::size_t{8} + direction),
+                                                      direction < 4 ? straight_cost_ : diagonal_cost_};
+    }
+    return range;
+  }
+
+  static int lowest_bit(std::uint64_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int bit = 0;
+    while (!(bits & 1)) bits >>= 1, ++bit;
+    return bit;
+#endif
+  }
+
+  static int highest_bit(std::uint64_t bits) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(bits);
+#else
+    int bit = 63;
+    while (!(bits >> 63)) bits <<= 1, --bit;
+    return bit;
+#endif
+  }
+
+  // Straight jump along one line, examining cells from position onwards in
+  // direction step (+1 or -1). Stops at the first cell that is blocked (no
+  // jump point), is the goal, or has a forced neighbour: a free cell on an
+  // adjacent line whose predecessor on that line is blocked, so a shortest
+  // path may have to turn there. Tests 64 cells at a time.
+  static bool scan(const BitLines& lines, std::ptrdiff_t line, std::ptrdiff_t position, int step,
+                   std::ptrdiff_t goal, std::ptrdiff_t& jump_point) {
+    while (true) {
+      // The window covers position .. position + 63 going forwards and
+      // position - 63 .. position going backwards
+      const auto first = step > 0 ? position : position - 63;
+      auto stops = ~lines.window(line, first);
+      for (const auto side : {line - 1, line + 1}) {
+        stops |= lines.window(side, first) & ~lines.window(side, first - step);
+      }
+      if (goal >= 0 && goal >= first && goal < first + 64) stops |= std::uint64_t{1} << (goal - first);
+      if (stops != 0) {
+        jump_point = first + (step > 0 ? lowest_bit(stops) : highest_bit(stops));
+        return lines.get(line, jump_point);
+      }
+      position += 64 * step;
+    }
+  }
+
+  // Jump from (x, y) in direction (dx, dy) to the next jump point. A diagonal
+  // jump stops at a cell from which a straight jump along either of its
+  // components finds one.
+  bool jump(std::ptrdiff_t x, std::ptrdiff_t y, int dx, int dy, index_type goal, std::ptrdiff_t& jump_x,
+            std::ptrdiff_t& jump_y) const {
+    const auto goal_x = column(goal), goal_y = row(goal);
+    auto horizontal = [&](std::ptrdiff_t from_x, std::ptrdiff_t at_y, std::ptrdiff_t& found) {
+      return scan(rows_, at_y, from_x, dx, at_y == goal_y ? goal_x : -1, found);
+    };
+    auto vertical = [&](std::ptrdiff_t at_x, std::ptrdiff_t from_y, std::ptrdiff_t& found) {
+      return scan(columns_, at_x, from_y, dy, at_x == goal_x ? goal_y : -1, found);
+    };
+
+    std::ptrdiff_t found = 0;
+    if (dy == 0) {
+      jump_y = y;
+      return horizontal(x + dx, y, jump_x);
+    }
+    if (dx == 0) {
+      jump_x = x;
+      return vertical(x, y + dy, jump_y);
+    }
+    for (x += dx, y += dy;; x += dx, y += dy) {
+      if (!passable(x, y)) return false;
+      if ((x == goal_x && y == goal_y) || horizontal(x + dx, y, found) || vertical(x, y + dy, found)) {
+        jump_x = x;
+        jump_y = y;
+        return true;
+      }
+      if (!passable(x + dx, y) || !passable(x, y + dy)) return false;
+    }
+  }
+
+  // A* over jump points with the octile distance as estimate. The directions
+  // worth jumping in from a jump point depend on the direction it was
+  // reached from: straight ahead, the diagonals next to it when their
+  // corners are free, and the sideways steps, which is where forced
+  // neighbours lie; from a diagonal, its two components and itself.
+  bool jump_point_search(SearchSpace& space, index_type src, index_type dest) const {
+    space.reset(vertex_count(), max_edge_cost());
+    if (src == dest) return true;
+    if (!passable(column(src), row(src))) return false; // Blocked cells have no edges
+    space.touch(src).distance = 0;
+    space.push(cell_distance(src, dest), src);
+
+    while (!space.queue_empty()) {
+      const auto current = space.pop().second;
+      auto& current_label = space.touch(current);
+      if (current_label.settled) continue;
+      current_label.settled = true;
+      if (current == dest) return true;
+
+      const auto current_cost = current_label.distance;
+      const auto x = column(current), y = row(current);
+      const auto from = current_label.predecessor;
+      const auto dx = sign(x - column(from)), dy = sign(y - row(from));
+
+      std::array<std::array<int, 2>, 8> directions;
+      std::size_t count = 0;
+      if (from == current) {
+        for (const auto& step : kSteps) directions[count++] = step;
+      } else if (dx != 0 && dy != 0) {
+        directions[count++] = {dx, 0};
+        directions[count++] = {0, dy};
+        directions[count++] = {dx, dy};
+      } else {
+        // Sideways is perpendicular to the direction of travel
+        const int side_x = dy, side_y = dx;
+        directions[count++] = {dx, dy};
+        for (const int side : {1, -1}) {
+          directions[count++] = {side * side_x, side * side_y};
+          directions[count++] = {dx + side * side_x, dy + side * side_y};
+        }
+      }
+
+      for (std::size_t i = 0; i < count; ++i) {
+        const auto [step_x, step_y] = directions[i];
+        std::ptrdiff_t jump_x = 0, jump_y = 0;
+        if (!can_step(x, y, step_x, step_y) || !jump(x, y, step_x, step_y, dest, jump_x, jump_y)) continue;
+        const auto next = index_at(jump_x, jump_y);
+        auto& label = space.touch(next);
+        if (label.settled) continue;
+        const auto new_cost = add_costs(current_cost, cell_distance(current, next));
+        if (new_cost < label.distance) {
+          label.distance = new_cost;
+          label.predecessor = current;
+          label.edge_used = kNoEdge; // Paths are expanded cell by cell afterwards
+          space.push(add_costs(new_cost, cell_distance(next, dest)), next);
+        }
+      }
+    }
+    return false;
+  }
 };
 
+// Occupancy grid with 32-bit ids, enough for grids of up to 2^29 cells.
+using OccupancyGrid = BasicOccupancyGrid<std::uint32_t, double>;
+
 using IdVector = std::vector<ShortestPathCalculator::id_type>;
 
+// Square grid with random edge costs in [1, max_cost] plus one isolated
+// vertex; searching for the isolated vertex settles the whole grid.
+ShortestPathCalculator make_benchmark_grid(std::size_t side, ShortestPathCalculator::cost_type max_cost,
+                                           IdVector& vertices) {
+  ShortestPathCalculator graph;
+  std::mt19937 rng(12345);
+  std::uniform_int_distribution<ShortestPathCalculator::cost_type> cost(1, max_cost);
+  vertices.clear();
+  for (std::size_t i = 0; i < side * side; ++i) vertices.push_back(graph.add_vertex());
+  for (std::size_t y = 0; y < side; ++y) {
+    for (std::size_t x = 0; x < side; ++x) {
+      const auto here = vertices[y * side + x];
+      if (x + 1 < side) {
+        graph.add_edge(here, vertices[y * side + x + 1], cost(rng));
+        graph.add_edge(vertices[y * side + x + 1], here, cost(rng));
+      }
+      if (y + 1 < side) {
+        graph.add_edge(here, vertices[(y + 1) * side + x], cost(rng));
+        graph.add_edge(vertices[(y + 1) * side + x], here, cost(rng));
+      }
+    }
+  }
+  vertices.push_back(graph.add_vertex());
+  return graph;
+}
+
 TEST(LifeFindsAWay, ConstructOk) {
   [[maybe_unused]] ShortestPathCalculator uut;
 }
@@ -235,11 +3861,52 @@ TEST(LifeFindsAWay, ShortestPathTwoVerticesMultipleEdges) {
 
   auto [nodes, edges] = uut.shortest_path(id1, id2);
 
-  const auto expected_nodes = IdVector{id1, id2};
-  const auto expected_edges = IdVector{edge2};
+  const auto expected_nodes = IdVector{id1, id2};
+  const auto expected_edges = IdVector{edge2};
+
+  ASSERT_EQ(nodes, expected_nodes);
+  ASSERT_EQ(edges, expected_edges);
+}
+
+TEST(LifeFindsAWay, ShortestPathWithInterleavedIds) {
+  // vertex and edge ids share one counter, so vertex ids have gaps in them
+  ShortestPathCalculator uut;
+  auto id1 = uut.add_vertex();
+  auto id2 = uut.add_vertex();
+  auto edge1 = uut.add_edge(id1, id2, 1);
+  auto id3 = uut.add_vertex();
+  auto edge2 = uut.add_edge(id2, id3, 1);
+  auto id4 = uut.add_vertex();
+  auto edge3 = uut.add_edge(id3, id4, 1);
+  auto [nodes, edges] = uut.shortest_path(id1, id4);
+
+  const auto expected_nodes = IdVector{id1, id2, id3, id4};
+  const auto expected_edges = IdVector{edge1, edge2, edge3};
 
   ASSERT_EQ(nodes, expected_nodes);
   ASSERT_EQ(edges, expected_edges);
+  ASSERT_THROW(uut.shortest_path(edge1, id4), std::runtime_error);
+}
+
+// Expects candidate(src, dst) to return what reference(src, dst) returns for
+// every pair of sources and targets, and to throw where the reference throws.
+template <typename Reference, typename Candidate>
+void expect_same_answers(const IdVector& sources, const IdVector& targets, Reference&& reference,
+                         Candidate&& candidate) {
+  for (const auto src : sources) {
+    for (const auto dst : targets) {
+      std::optional<std::decay_t<decltype(reference(src, dst))>> expected;
+      try {
+        expected = reference(src, dst);
+      } catch (const std::runtime_error&) {
+      }
+      if (expected) {
+        EXPECT_EQ(candidate(src, dst), *expected) << src << " -> " << dst;
+      } else {
+        EXPECT_THROW(candidate(src, dst), std::runtime_error) << src << " -> " << dst;
+      }
+    }
+  }
 }
 
 class ComplexGraph : public ::testing::Test {
@@ -269,6 +3936,13 @@ protected:
     e87 = uut.add_edge(v8, v7, 1);
   }
 
+  // compares the answers for every pair of the vertices above
+  template <typename Reference, typename Candidate>
+  void expect_same_answers(Reference&& reference, Candidate&& candidate) const {
+    const auto vertices = IdVector{v1, v2, v3, v4, v5, v6, v7, v8};
+    ::expect_same_answers(vertices, vertices, reference, candidate);
+  }
+
   ShortestPathCalculator uut;
   std::size_t v1, v2, v3, v4, v5, v6, v7, v8;
   std::size_t e12, e13, e23, e24, e34, e36, e45, e56, e64, e78, e87;
@@ -325,6 +3999,1223 @@ TEST_F(ComplexGraph, TestPathBetweenNodesWithNoPathBetweenThem) {
   ASSERT_THROW(uut.shortest_path(v5, v1), std::runtime_error);
 }
 
+TEST_F(ComplexGraph, ShortestDistanceWithoutPath) {
+  // the distance-only query reports unreachable pairs as an empty optional
+  EXPECT_EQ(uut.shortest_distance(v1, v5), std::optional<std::size_t>(7));
+  EXPECT_EQ(uut.shortest_distance(v2, v4), std::optional<std::size_t>(5));
+  EXPECT_EQ(uut.shortest_distance(v4, v4), std::optional<std::size_t>(0));
+  EXPECT_FALSE(uut.shortest_distance(v1, v8).has_value());
+  EXPECT_FALSE(uut.shortest_distance(v5, v1).has_value());
+  ASSERT_THROW(uut.shortest_distance(v1, e12), std::runtime_error);
+
+  ShortestPathCalculator::QueryWorkspace workspace;
+  EXPECT_EQ(uut.shortest_distance(v1, v5, workspace, ShortestPathCalculator::SearchMode::bidirectional),
+            std::optional<std::size_t>(7));
+  EXPECT_FALSE(
+      uut.shortest_distance(v7, v1, workspace, ShortestPathCalculator::SearchMode::bidirectional).has_value());
+}
+
+TEST_F(ComplexGraph, TryShortestPathReportsStatus) {
+  // the non-throwing query fills the caller's buffers and returns a status
+  using Status = ShortestPathCalculator::PathStatus;
+  ShortestPathCalculator::QueryWorkspace workspace;
+  IdVector nodes, edges;
+
+  ASSERT_EQ(uut.try_shortest_path(v1, v5, nodes, edges, workspace), Status::found);
+  EXPECT_EQ(nodes, (IdVector{v1, v3, v6, v4, v5}));
+  EXPECT_EQ(edges, (IdVector{e13, e36, e64, e45}));
+
+  // buffers are cleared, never appended to, and keep their capacity
+  const auto* storage = nodes.data();
+  ASSERT_EQ(uut.try_shortest_path(v3, v4, nodes, edges, workspace), Status::found);
+  EXPECT_EQ(nodes, (IdVector{v3, v6, v4}));
+  EXPECT_EQ(edges, (IdVector{e36, e64}));
+  EXPECT_EQ(nodes.data(), storage);
+
+  EXPECT_EQ(uut.try_shortest_path(v1, v8, nodes, edges, workspace), Status::no_path);
+  EXPECT_TRUE(nodes.empty());
+  EXPECT_TRUE(edges.empty());
+  EXPECT_EQ(uut.try_shortest_path(v1, e12, nodes, edges, workspace), Status::invalid_vertex);
+  EXPECT_EQ(uut.snapshot().try_shortest_path(0, v1, nodes, edges), Status::invalid_vertex);
+
+  ASSERT_EQ(uut.try_shortest_path(v2, v5, nodes, edges, workspace, ShortestPathCalculator::SearchMode::bidirectional),
+            Status::found);
+  EXPECT_EQ(nodes, (IdVector{v2, v3, v6, v4, v5}));
+  EXPECT_EQ(edges, (IdVector{e23, e36, e64, e45}));
+}
+
+TEST_F(ComplexGraph, QueryStatsCountSearchWork) {
+  // a workspace with QueryStats reports what its last query did, and
+  // workspaces can add up all their queries in one shared aggregate
+  using Calculator = ShortestPathCalculator;
+  Calculator::BasicQueryWorkspace<Calculator::BinaryHeapQueue, QueryStats> workspace;
+  AggregateQueryStats totals;
+  workspace.aggregate_into(&totals);
+
+  // v7 cannot be reached, so everything reachable from v1 gets settled
+  EXPECT_FALSE(uut.shortest_distance(v1, v7, workspace).has_value());
+  auto stats = workspace.stats();
+  EXPECT_EQ(stats.settled, 6);
+  EXPECT_EQ(stats.edges_relaxed, 9);
+  EXPECT_EQ(stats.pushes, 8);
+  EXPECT_EQ(stats.stale_pops, 2); // v4 was queued with costs 11, 6 and 5
+  // a coarse clock can read zero for a search this small, so the timers are
+  // only checked for what they must be; the counters above show the work
+  EXPECT_GE(stats.search_time.count(), 0);
+  EXPECT_EQ(stats.trace_time.count(), 0);
+
+  EXPECT_EQ(std::get<0>(uut.shortest_path(v1, v5, workspace)), (IdVector{v1, v3, v6, v4, v5}));
+  stats = workspace.stats();
+  EXPECT_EQ(stats.settled, 6);
+  EXPECT_EQ(stats.stale_pops, 1);
+  EXPECT_GE(stats.trace_time.count(), 0);
+
+  // failed queries are counted too
+  EXPECT_THROW(uut.shortest_path(v7, v1, workspace), std::runtime_error);
+  EXPECT_EQ(workspace.stats().settled, 2);
+
+  IdVector nodes, edges;
+  uut.try_shortest_path(v1, v5, nodes, edges, workspace, Calculator::SearchMode::bidirectional);
+  EXPECT_GT(workspace.stats().settled, 0);
+
+  // a heap with decrease-key never holds stale entries
+  Calculator::BasicQueryWorkspace<Calculator::DaryHeapQueue<>, QueryStats> dary;
+  dary.aggregate_into(&totals);
+  EXPECT_FALSE(uut.snapshot().shortest_distance(v1, v7, dary).has_value());
+  EXPECT_EQ(dary.stats().settled, 6);
+  EXPECT_EQ(dary.stats().stale_pops, 0);
+
+  EXPECT_EQ(totals.queries(), 5);
+  EXPECT_EQ(totals.max_settled(), 6);
+  EXPECT_EQ(totals.totals().settled, 6 + 6 + 2 + workspace.stats().settled + 6);
+}
+
+TEST_F(ComplexGraph, NearestTargetsFromOneSearch) {
+  // the k closest of a target set come back closest first, each with the
+  // same path shortest_path() finds; repeated and unreachable targets drop out
+  ShortestPathCalculator::QueryWorkspace workspace;
+  const auto nearest = uut.nearest_targets(v1, {v5, v4, v8, v6, v4}, 2, workspace);
+  ASSERT_EQ(nearest.size(), 2);
+  EXPECT_EQ(nearest[0].target, v6);
+  EXPECT_EQ(nearest[0].cost, 4);
+  EXPECT_EQ(nearest[0].path, std::make_tuple(IdVector{v1, v3, v6}, IdVector{e13, e36}));
+  EXPECT_EQ(nearest[1].target, v4);
+  EXPECT_EQ(nearest[1].cost, 5);
+  EXPECT_EQ(nearest[1].path, uut.shortest_path(v1, v4));
+
+  const auto all = uut.snapshot().nearest_targets(v1, {v5, v4, v8, v6}, 10);
+  ASSERT_EQ(all.size(), 3);
+  EXPECT_EQ(all[2].target, v5);
+  EXPECT_EQ(all[2].cost, 7);
+  EXPECT_EQ(all[2].path, uut.shortest_path(v1, v5));
+
+  EXPECT_EQ(uut.nearest_targets(v1, {v1, v2}, 1)[0].path, std::make_tuple(IdVector{v1}, IdVector{}));
+  EXPECT_TRUE(uut.nearest_targets(v1, {v5}, 0).empty());
+  EXPECT_TRUE(uut.nearest_targets(v7, {v5}, 1).empty());
+  EXPECT_THROW(uut.nearest_targets(v1, {v5, e12}, 1), std::runtime_error);
+}
+
+TEST_F(ComplexGraph, KShortestLooplessPaths) {
+  // alternatives come back cheapest first, never revisit a vertex and use
+  // the same node and edge ids as shortest_path()
+  const auto paths = uut.k_shortest_paths(v1, v5, 10);
+  ASSERT_EQ(paths.size(), 5);
+  std::vector<ShortestPathCalculator::cost_type> costs;
+  for (const auto& alternative : paths) costs.push_back(alternative.cost);
+  EXPECT_EQ(costs, (std::vector<ShortestPathCalculator::cost_type>{7, 8, 8, 9, 13}));
+  EXPECT_EQ(paths[0].path, uut.shortest_path(v1, v5));
+  // equal costs: fewer hops first
+  EXPECT_EQ(paths[1].path, std::make_tuple(IdVector{v1, v3, v4, v5}, IdVector{e13, e34, e45}));
+  EXPECT_EQ(paths[2].path, std::make_tuple(IdVector{v1, v2, v3, v6, v4, v5}, IdVector{e12, e23, e36, e64, e45}));
+  EXPECT_EQ(paths[3].path, std::make_tuple(IdVector{v1, v2, v3, v4, v5}, IdVector{e12, e23, e34, e45}));
+  EXPECT_EQ(paths[4].path, std::make_tuple(IdVector{v1, v2, v4, v5}, IdVector{e12, e24, e45}));
+
+  ShortestPathCalculator::QueryWorkspace workspace;
+  const auto two = uut.snapshot().k_shortest_paths(v1, v5, 2, workspace);
+  ASSERT_EQ(two.size(), 2);
+  EXPECT_EQ(two[1].path, paths[1].path);
+
+  EXPECT_EQ(uut.k_shortest_paths(v4, v4, 3).size(), 1);
+  EXPECT_TRUE(uut.k_shortest_paths(v1, v7, 3).empty());
+  EXPECT_THROW(uut.k_shortest_paths(v1, e12, 3), std::runtime_error);
+}
+
+TEST_F(ComplexGraph, CostFieldsFromSeveralOrigins) {
+  // one reverse search gives every vertex its cost to the nearest goal and
+  // the edge to take from there; a forward field does the same from sources
+  const auto to_v5 = uut.cost_to_go(v5);
+  for (const auto vertex : {v1, v2, v3, v4, v5, v6, v7, v8}) {
+    const auto expected = uut.shortest_distance(vertex, v5);
+    EXPECT_EQ(to_v5.cost(vertex), expected.value_or(ShortestPathCalculator::kUnreachable));
+    if (expected) {
+      EXPECT_EQ(to_v5.path(vertex), uut.shortest_path(vertex, v5));
+    }
+  }
+  EXPECT_EQ(to_v5.next_edge(v2), e23);
+  EXPECT_EQ(to_v5.next_edge(v5), ShortestPathCalculator::kNoEdge);
+  EXPECT_THROW(to_v5.path(v7), std::runtime_error);
+
+  ShortestPathCalculator::QueryWorkspace workspace;
+  const auto to_v4_or_v7 = uut.snapshot().cost_to_go({v4, v7}, workspace);
+  EXPECT_EQ(to_v4_or_v7.cost(v3), 4);
+  EXPECT_EQ(to_v4_or_v7.cost(v5), 12);
+  EXPECT_EQ(to_v4_or_v7.path(v8), std::make_tuple(IdVector{v8, v7}, IdVector{e87}));
+
+  const auto from_v2_or_v6 = uut.cost_field({v2, v6, v6});
+  EXPECT_EQ(from_v2_or_v6.cost(v6), 0);
+  EXPECT_EQ(from_v2_or_v6.cost(v4), 1);
+  EXPECT_EQ(from_v2_or_v6.cost(v1), ShortestPathCalculator::kUnreachable);
+  EXPECT_EQ(from_v2_or_v6.path(v5), std::make_tuple(IdVector{v6, v4, v5}, IdVector{e64, e45}));
+  EXPECT_THROW(uut.cost_field({v1, e12}), std::runtime_error);
+}
+
+TEST_F(ComplexGraph, BulkInsertionMatchesSingleInsertion) {
+  // the same graph built in bulk gets the same ids and the same paths
+  ShortestPathCalculator bulk;
+  bulk.reserve(8, 11);
+  const auto vertices = bulk.add_vertices(8);
+  ASSERT_EQ(vertices, (IdVector{v1, v2, v3, v4, v5, v6, v7, v8}));
+
+  auto vertex = [&vertices](std::size_t number) { return vertices[number - 1]; };
+  const auto edges = bulk.add_edges({{vertex(1), vertex(2), 1}, {vertex(1), vertex(3), 1}, {vertex(2), vertex(3), 1},
+                                     {vertex(2), vertex(4), 10}, {vertex(3), vertex(4), 5}, {vertex(3), vertex(6), 3},
+                                     {vertex(4), vertex(5), 2}, {vertex(5), vertex(6), 11}, {vertex(6), vertex(4), 1},
+                                     {vertex(7), vertex(8), 1}, {vertex(8), vertex(7), 1}});
+  ASSERT_EQ(edges, (IdVector{e12, e13, e23, e24, e34, e36, e45, e56, e64, e78, e87}));
+
+  expect_same_answers([&](auto src, auto dst) { return uut.shortest_distance(src, dst); },
+                      [&](auto src, auto dst) { return bulk.shortest_distance(src, dst); });
+  expect_same_answers([&](auto src, auto dst) { return uut.shortest_path(src, dst); },
+                      [&](auto src, auto dst) { return bulk.shortest_path(src, dst); });
+
+  // one bad endpoint rejects the whole batch
+  EXPECT_THROW(bulk.add_edges({{v1, v8, 1}, {v1, e12, 1}}), std::runtime_error);
+  EXPECT_EQ(bulk.snapshot().edge_count(), 11);
+  EXPECT_FALSE(bulk.shortest_distance(v1, v8).has_value());
+  EXPECT_EQ(bulk.add_vertex(), e87 + 1);
+}
+
+TEST_F(ComplexGraph, SnapshotMatchesCalculator) {
+  // the compact snapshot must return exactly the same paths as the calculator
+  const auto snapshot = uut.snapshot();
+  ASSERT_EQ(snapshot.vertex_count(), 8);
+  ASSERT_EQ(snapshot.edge_count(), 11);
+
+  expect_same_answers([&](auto src, auto dst) { return uut.shortest_path(src, dst); },
+                      [&](auto src, auto dst) { return snapshot.shortest_path(src, dst); });
+}
+
+TEST_F(ComplexGraph, SnapshotIsImmutable) {
+  // changes to the calculator after taking a snapshot are not visible in it
+  const auto snapshot = uut.snapshot();
+  auto e18 = uut.add_edge(v1, v8, 1);
+  auto [nodes, edges] = uut.shortest_path(v1, v8);
+  EXPECT_EQ(nodes, (IdVector{v1, v8}));
+  EXPECT_EQ(edges, (IdVector{e18}));
+  EXPECT_THROW(snapshot.shortest_path(v1, v8), std::runtime_error);
+  EXPECT_THROW(snapshot.shortest_path(v1, uut.add_vertex()), std::runtime_error);
+}
+
+TEST_F(ComplexGraph, SnapshotSavedAndLoaded) {
+  // a loaded file answers exactly like the snapshot it was saved from, and
+  // converts back into an editable calculator that keeps the ids
+  const auto path = ::testing::TempDir() + "complex_graph.bin";
+  const auto saved = uut.snapshot();
+  saved.save(path);
+  const auto loaded = ShortestPathCalculator::Snapshot::load(path);
+  ASSERT_EQ(loaded.vertex_count(), 8);
+  ASSERT_EQ(loaded.edge_count(), 11);
+  EXPECT_EQ(loaded.max_edge_cost(), 11);
+
+  expect_same_answers([&](auto src, auto dst) { return saved.shortest_distance(src, dst); },
+                      [&](auto src, auto dst) { return loaded.shortest_distance(src, dst); });
+  expect_same_answers([&](auto src, auto dst) { return saved.shortest_path(src, dst); },
+                      [&](auto src, auto dst) { return loaded.shortest_path(src, dst); });
+
+  ShortestPathCalculator reloaded(loaded);
+  const auto v9 = reloaded.add_vertex();
+  const auto e59 = reloaded.add_edge(v5, v9, 1);
+  EXPECT_GT(v9, e87);
+  EXPECT_NE(v9, e59);
+  auto [nodes, edges] = reloaded.shortest_path(v1, v9);
+  EXPECT_EQ(nodes, (IdVector{v1, v3, v6, v4, v5, v9}));
+  EXPECT_EQ(edges, (IdVector{e13, e36, e64, e45, e59}));
+  reloaded.remove_edge(e64);
+  EXPECT_EQ(reloaded.shortest_distance(v1, v9), std::optional<std::size_t>(9));
+  std::remove(path.c_str());
+}
+
+TEST(LifeFindsAWay, LoadRejectsInvalidFiles) {
+  // missing, foreign and truncated files are refused up front
+  const auto path = ::testing::TempDir() + "invalid_graph.bin";
+  EXPECT_THROW(ShortestPathCalculator::Snapshot::load(path + ".missing"), std::runtime_error);
+
+  std::ofstream(path, std::ios::binary) << "definitely not a graph file, but long enough for a header";
+  EXPECT_THROW(ShortestPathCalculator::Snapshot::load(path), std::runtime_error);
+
+  ShortestPathCalculator graph;
+  const auto v1 = graph.add_vertex();
+  const auto v2 = graph.add_vertex();
+  graph.add_edge(v1, v2, 3);
+  graph.snapshot().save(path);
+  std::string bytes;
+  {
+    std::ifstream in(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size() - 8);
+  EXPECT_THROW(ShortestPathCalculator::Snapshot::load(path), std::runtime_error);
+
+  // so are files whose arrays would send a query out of bounds. Each field
+  // is found from the header and holds its saved value before it is patched.
+  using Snapshot = ShortestPathCalculator::Snapshot;
+  Snapshot::FileHeader header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  ASSERT_EQ(header.vertex_count, 2);
+  ASSERT_EQ(header.edge_count, 1);
+  ASSERT_EQ(header.edge_size, sizeof(ShortestPathCalculator::index_type) + sizeof(ShortestPathCalculator::id_type) +
+                                  sizeof(ShortestPathCalculator::cost_type));
+  const auto ids = sizeof(header);
+  const auto offsets = ids + Snapshot::padded(header.vertex_count * header.id_size);
+  const auto edges = offsets + Snapshot::padded((header.vertex_count + 1) * header.offset_size);
+  const auto edge_cost = edges + header.edge_size - sizeof(ShortestPathCalculator::cost_type);
+
+  auto saved = [&](std::size_t position, auto value) {
+    std::memcpy(&value, &bytes[position], sizeof(value));
+    return value;
+  };
+  auto load_patched = [&](std::size_t position, auto value) {
+    auto patched = bytes;
+    std::memcpy(&patched[position], &value, sizeof(value));
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(patched.data(), patched.size());
+    return Snapshot::load(path);
+  };
+  ASSERT_EQ(saved(ids, ShortestPathCalculator::id_type{}), v1);
+  ASSERT_EQ(saved(offsets + header.offset_size, std::size_t{}), 1);
+  ASSERT_EQ(saved(edges, ShortestPathCalculator::index_type{}), 1);
+  ASSERT_EQ(saved(edge_cost, ShortestPathCalculator::cost_type{}), 3);
+  ASSERT_EQ(saved(offsetof(Snapshot::FileHeader, vertex_count), std::uint64_t{}), 2);
+
+  // a cheaper edge is still valid and shows up in the loaded snapshot
+  EXPECT_EQ(load_patched(edge_cost, ShortestPathCalculator::cost_type{2}).shortest_distance(v1, v2),
+            std::optional<std::size_t>(2));
+  // ids out of order, offsets going back, an edge target past the vertices,
+  // a cost above the maximum and a vertex count that would overflow
+  EXPECT_THROW(load_patched(ids, ShortestPathCalculator::id_type{1000}), std::runtime_error);
+  EXPECT_THROW(load_patched(offsets + header.offset_size, std::size_t{5}), std::runtime_error);
+  EXPECT_THROW(load_patched(edges, ShortestPathCalculator::index_type{7}), std::runtime_error);
+  EXPECT_THROW(load_patched(edge_cost, ShortestPathCalculator::cost_type{100}), std::runtime_error);
+  EXPECT_THROW(load_patched(offsetof(Snapshot::FileHeader, vertex_count), std::uint64_t{1} << 62), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST_F(ComplexGraph, WorkspaceReusedAcrossQueries) {
+  // one workspace serves many queries, on the calculator and on its snapshot,
+  // without earlier searches leaking into later ones
+  ShortestPathCalculator::QueryWorkspace workspace;
+  const auto snapshot = uut.snapshot();
+
+  for (int round = 0; round < 3; ++round) {
+    auto [nodes, edges] = uut.shortest_path(v1, v5, workspace);
+    EXPECT_EQ(nodes, (IdVector{v1, v3, v6, v4, v5}));
+    EXPECT_EQ(edges, (IdVector{e13, e36, e64, e45}));
+
+    EXPECT_THROW(uut.shortest_path(v5, v1, workspace), std::runtime_error);
+
+    auto [loop_nodes, loop_edges] = snapshot.shortest_path(v4, v6, workspace);
+    EXPECT_EQ(loop_nodes, (IdVector{v4, v5, v6}));
+    EXPECT_EQ(loop_edges, (IdVector{e45, e56}));
+
+    auto [self_nodes, self_edges] = uut.shortest_path(v7, v7, workspace);
+    EXPECT_EQ(self_nodes, (IdVector{v7}));
+    EXPECT_TRUE(self_edges.empty());
+  }
+
+  // the workspace grows when the graph does
+  auto v9 = uut.add_vertex();
+  auto e89 = uut.add_edge(v8, v9, 4);
+  auto [nodes, edges] = uut.shortest_path(v7, v9, workspace);
+  EXPECT_EQ(nodes, (IdVector{v7, v8, v9}));
+  EXPECT_EQ(edges, (IdVector{e78, e89}));
+}
+
+TEST_F(ComplexGraph, BidirectionalMatchesUnidirectional) {
+  // the bidirectional search must find exactly the same paths, on the
+  // calculator and on its snapshot
+  using SearchMode = ShortestPathCalculator::SearchMode;
+  const auto snapshot = uut.snapshot();
+  ShortestPathCalculator::QueryWorkspace workspace;
+
+  auto dijkstra = [&](auto src, auto dst) { return uut.shortest_path(src, dst); };
+  expect_same_answers(dijkstra,
+                      [&](auto src, auto dst) { return uut.shortest_path(src, dst, SearchMode::bidirectional); });
+  expect_same_answers(dijkstra, [&](auto src, auto dst) {
+    return snapshot.shortest_path(src, dst, workspace, SearchMode::bidirectional);
+  });
+}
+
+TEST(LifeFindsAWay, BidirectionalPrefersCheapestParallelEdge) {
+  // parallel edges and a detour of equal cost to the direct route
+  using SearchMode = ShortestPathCalculator::SearchMode;
+  ShortestPathCalculator uut;
+  auto id1 = uut.add_vertex();
+  auto id2 = uut.add_vertex();
+  auto id3 = uut.add_vertex();
+  uut.add_edge(id1, id2, 3);
+  auto edge2 = uut.add_edge(id1, id2, 1);
+  auto edge3 = uut.add_edge(id2, id3, 1);
+  uut.add_edge(id1, id3, 5);
+
+  auto [nodes, edges] = uut.shortest_path(id1, id3, SearchMode::bidirectional);
+  ASSERT_EQ(nodes, (IdVector{id1, id2, id3}));
+  ASSERT_EQ(edges, (IdVector{edge2, edge3}));
+}
+
+TEST_F(ComplexGraph, AStarMatchesDijkstra) {
+  // a zero heuristic degenerates to Dijkstra, and exact remaining costs
+  // (computed here by brute force) lead straight to the destination
+  using cost_type = ShortestPathCalculator::cost_type;
+  const std::unordered_map<std::size_t, cost_type> edge_costs{
+      {e12, 1}, {e13, 1}, {e23, 1}, {e24, 10}, {e34, 5}, {e36, 3},
+      {e45, 2}, {e56, 11}, {e64, 1}, {e78, 1}, {e87, 1}};
+
+  auto exact_to = [&](ShortestPathCalculator::id_type dst) {
+    return [&, dst](ShortestPathCalculator::id_type vertex) {
+      try {
+        const auto edges = std::get<1>(uut.shortest_path(vertex, dst));
+        cost_type cost = 0;
+        for (const auto edge : edges) cost += edge_costs.at(edge);
+        return cost;
+      } catch (const std::runtime_error&) {
+        return ShortestPathCalculator::kUnreachable;
+      }
+    };
+  };
+  auto zero = [](ShortestPathCalculator::id_type) { return cost_type{0}; };
+
+  ShortestPathCalculator::QueryWorkspace workspace;
+  auto dijkstra = [&](auto src, auto dst) { return uut.shortest_path(src, dst); };
+  expect_same_answers(dijkstra, [&](auto src, auto dst) { return uut.shortest_path(src, dst, zero); });
+  expect_same_answers(dijkstra,
+                      [&](auto src, auto dst) { return uut.shortest_path(src, dst, workspace, exact_to(dst)); });
+}
+
+TEST_F(ComplexGraph, LandmarksMatchDijkstra) {
+  // ALT search with chosen and with automatically selected landmarks
+  const auto chosen = uut.make_landmarks(IdVector{v1, v5});
+  const auto selected = uut.make_landmarks(3);
+  ASSERT_EQ(chosen.size(), 2);
+  ASSERT_EQ(selected.size(), 3);
+
+  const auto snapshot = uut.snapshot();
+  ShortestPathCalculator::QueryWorkspace workspace;
+  auto dijkstra = [&](auto src, auto dst) { return uut.shortest_path(src, dst); };
+  expect_same_answers(dijkstra, [&](auto src, auto dst) { return uut.shortest_path(src, dst, chosen); });
+  expect_same_answers(dijkstra,
+                      [&](auto src, auto dst) { return snapshot.shortest_path(src, dst, workspace, selected); });
+}
+
+TEST(LifeFindsAWay, LandmarksAcrossZeroCostEdges) {
+  // a vertex at distance zero from a landmark can still become one, and a
+  // small graph gets every vertex as a landmark
+  ShortestPathCalculator uut;
+  auto id1 = uut.add_vertex();
+  auto id2 = uut.add_vertex();
+  auto id3 = uut.add_vertex();
+  uut.add_edge(id1, id2, 0);
+  uut.add_edge(id2, id1, 0);
+  auto edge3 = uut.add_edge(id2, id3, 4);
+
+  EXPECT_EQ(uut.make_landmarks(3).size(), 3);
+  const auto landmarks = uut.make_landmarks(5);
+  auto ids = landmarks.ids();
+  std::sort(ids.begin(), ids.end());
+  EXPECT_EQ(ids, (IdVector{id1, id2, id3}));
+  EXPECT_EQ(std::get<1>(uut.shortest_path(id1, id3, landmarks)), std::get<1>(uut.shortest_path(id1, id3)));
+  EXPECT_EQ(std::get<1>(uut.shortest_path(id2, id3, landmarks)), IdVector{edge3});
+}
+
+TEST_F(ComplexGraph, ContractionHierarchyMatchesDijkstra) {
+  // paths found through the hierarchy unpack to the original edges
+  const auto hierarchy = uut.contraction_hierarchy();
+  ASSERT_EQ(hierarchy.vertex_count(), 8);
+
+  ShortestPathCalculator::QueryWorkspace workspace;
+  expect_same_answers([&](auto src, auto dst) { return uut.shortest_path(src, dst); },
+                      [&](auto src, auto dst) { return hierarchy.shortest_path(src, dst, workspace); });
+  EXPECT_THROW(hierarchy.shortest_path(v1, e12), std::runtime_error);
+}
+
+TEST(LifeFindsAWay, ContractionHierarchyUnpacksShortcuts) {
+  // contracting the middle of a line needs shortcuts, which must unpack to
+  // the original edges in order
+  ShortestPathCalculator uut;
+  IdVector vertices, edges;
+  for (int i = 0; i < 6; ++i) vertices.push_back(uut.add_vertex());
+  for (int i = 0; i + 1 < 6; ++i) edges.push_back(uut.add_edge(vertices[i], vertices[i + 1], 2));
+  uut.add_edge(vertices[0], vertices[5], 11);
+
+  const auto hierarchy = uut.contraction_hierarchy();
+  EXPECT_GT(hierarchy.shortcut_count(), 0);
+  auto [path_nodes, path_edges] = hierarchy.shortest_path(vertices.front(), vertices.back());
+  EXPECT_EQ(path_nodes, vertices);
+  EXPECT_EQ(path_edges, edges);
+}
+
+TEST_F(ComplexGraph, DistanceTableMatchesShortestPaths) {
+  // every cell of the table agrees with a separate shortest_path() call
+  ThreadPool pool(3);
+  const auto sources = IdVector{v1, v2, v4, v7, v1};
+  const auto targets = IdVector{v5, v6, v8, v1, v5};
+  const auto table = uut.distance_table(sources, targets, pool, true);
+  ASSERT_EQ(table.source_count, sources.size());
+  ASSERT_EQ(table.target_count, targets.size());
+
+  for (std::size_t row = 0; row < sources.size(); ++row) {
+    for (std::size_t column = 0; column < targets.size(); ++column) {
+      try {
+        const auto expected = uut.shortest_path(sources[row], targets[column]);
+        EXPECT_EQ(table.path(row, column), expected);
+        EXPECT_NE(table.cost(row, column), ShortestPathCalculator::kUnreachable);
+      } catch (const std::runtime_error&) {
+        EXPECT_EQ(table.cost(row, column), ShortestPathCalculator::kUnreachable);
+      }
+    }
+  }
+  EXPECT_EQ(table.cost(0, 0), 7);
+  EXPECT_EQ(table.cost(2, 1), 13);
+  EXPECT_EQ(table.cost(3, 2), 1);
+
+  const auto costs_only = uut.snapshot().distance_table(sources, targets);
+  EXPECT_EQ(costs_only.costs, table.costs);
+  EXPECT_TRUE(costs_only.paths.empty());
+  EXPECT_THROW(uut.distance_table(sources, IdVector{e12}, pool), std::runtime_error);
+}
+
+TEST_F(ComplexGraph, ShortestPathTreeMatchesShortestPaths) {
+  // delta-stepping must agree with one Dijkstra query per target, whatever
+  // the bucket width and however many workers share the vertices
+  ThreadPool pool(3);
+  const auto vertices = IdVector{v1, v2, v3, v4, v5, v6, v7, v8};
+  const auto unreachable = ShortestPathCalculator::kUnreachable;
+  const auto no_edge = ShortestPathCalculator::kNoEdge;
+  for (const ShortestPathCalculator::cost_type width : {0, 1, 2, 4, 100}) {
+    std::unordered_map<std::size_t, ShortestPathCalculator::ShortestPathTree> trees;
+    for (const auto src : vertices) {
+      const auto& tree = trees.emplace(src, uut.shortest_path_tree(src, pool, width)).first->second;
+      ASSERT_EQ(tree.source, src);
+      ASSERT_EQ(tree.distances.size(), vertices.size());
+      EXPECT_EQ(tree.predecessor_edge(src), ShortestPathCalculator::kNoEdge);
+    }
+    expect_same_answers([&](auto src, auto dst) { return uut.shortest_distance(src, dst).value_or(unreachable); },
+                        [&](auto src, auto dst) { return trees.at(src).distance(dst); });
+    // only the source and unreachable vertices have no predecessor
+    expect_same_answers([&](auto src, auto dst) { return src != dst && uut.shortest_distance(src, dst); },
+                        [&](auto src, auto dst) { return trees.at(src).predecessor_edge(dst) != no_edge; });
+    // shortest paths are unique in this graph, so no tie can make the tree
+    // pick another one
+    expect_same_answers([&](auto src, auto dst) { return uut.shortest_path(src, dst); },
+                        [&](auto src, auto dst) { return trees.at(src).path(dst); });
+  }
+  EXPECT_THROW(uut.shortest_path_tree(e12, pool), std::runtime_error);
+  EXPECT_EQ(uut.snapshot().shortest_path_tree(v1, pool).distance(v5), 7);
+}
+
+TEST_F(ComplexGraph, UpdateAndRemoveEdges) {
+  // a costlier corridor reroutes the path, a removed one is never used again
+  uut.update_edge_cost(e36, 10);
+  auto [nodes, edges] = uut.shortest_path(v1, v4);
+  EXPECT_EQ(nodes, (IdVector{v1, v3, v4}));
+  EXPECT_EQ(edges, (IdVector{e13, e34}));
+
+  uut.remove_edge(e34);
+  std::tie(nodes, edges) = uut.shortest_path(v1, v4);
+  EXPECT_EQ(nodes, (IdVector{v1, v2, v4}));
+  EXPECT_EQ(edges, (IdVector{e12, e24}));
+
+  uut.update_edge_cost(e36, 3);
+  std::tie(nodes, edges) = uut.shortest_path(v1, v4);
+  EXPECT_EQ(nodes, (IdVector{v1, v3, v6, v4}));
+  EXPECT_EQ(uut.snapshot().edge_count(), 10);
+
+  EXPECT_THROW(uut.remove_edge(e34), std::runtime_error);
+  EXPECT_THROW(uut.update_edge_cost(e34, 1), std::runtime_error);
+  EXPECT_THROW(uut.update_edge_cost(v1, 1), std::runtime_error);
+}
+
+TEST(LifeFindsAWay, CachedTreesFollowEdgeChanges) {
+  // after every change the repaired trees must match a fresh search
+  IdVector vertices;
+  auto graph = make_benchmark_grid(8, 20, vertices);
+  std::mt19937 rng(2024);
+  std::vector<ShortestPathCalculator::id_type> edge_ids;
+  for (std::size_t i = 0; i + 1 < vertices.size(); ++i) {
+    edge_ids.push_back(graph.add_edge(vertices[i], vertices[(i * 7 + 3) % (vertices.size() - 1)], 15));
+  }
+  const auto sources = IdVector{vertices[0], vertices[27], vertices[63]};
+  for (const auto src : sources) graph.cached_shortest_path_tree(src);
+
+  for (int round = 0; round < 200; ++round) {
+    const auto pick = rng() % edge_ids.size();
+    switch (rng() % 4) {
+    case 0:
+      graph.remove_edge(edge_ids[pick]);
+      edge_ids[pick] = edge_ids.back();
+      edge_ids.pop_back();
+      break;
+    case 1:
+      edge_ids.push_back(graph.add_edge(vertices[rng() % vertices.size()], vertices[rng() % vertices.size()],
+                                        1 + rng() % 20));
+      break;
+    default:
+      graph.update_edge_cost(edge_ids[pick], 1 + rng() % 20);
+    }
+    if (round % 10 == 0) vertices.push_back(graph.add_vertex());
+
+    const auto source = sources[round % sources.size()];
+    const auto& tree = graph.cached_shortest_path_tree(source);
+    const auto unreachable = ShortestPathCalculator::kUnreachable;
+    expect_same_answers({source}, vertices,
+                        [&](auto src, auto dst) { return graph.shortest_distance(src, dst).value_or(unreachable); },
+                        [&](auto, auto dst) { return tree.distance(dst); });
+    // ties may pick other paths, so only the ends of each path are compared
+    auto ends = [](const auto& path) {
+      const auto& [nodes, edges] = path;
+      EXPECT_EQ(nodes.size(), edges.size() + 1);
+      return std::make_pair(nodes.front(), nodes.back());
+    };
+    expect_same_answers({source}, vertices, [&](auto src, auto dst) { return ends(graph.shortest_path(src, dst)); },
+                        [&](auto src, auto dst) { return ends(graph.cached_shortest_path(src, dst)); });
+    ASSERT_FALSE(HasFailure()) << "round " << round;
+  }
+}
+
+TEST(ThreadPoolTest, RunsEveryIndexOnce) {
+  // each index runs exactly once, and task exceptions reach the caller
+  ThreadPool pool(4);
+  ASSERT_EQ(pool.size(), 4);
+  for (int round = 0; round < 10; ++round) {
+    std::vector<std::atomic<int>> hits(1000);
+    pool.parallel_for(hits.size(), [&](std::size_t index, std::size_t worker) {
+      ASSERT_LT(worker, pool.size());
+      ++hits[index];
+    });
+    for (const auto& hit : hits) ASSERT_EQ(hit.load(), 1);
+  }
+  EXPECT_THROW(pool.parallel_for(10, [](std::size_t index, std::size_t) {
+                 if (index == 7) throw std::runtime_error("task failed");
+               }),
+               std::runtime_error);
+}
+
+TEST(LifeFindsAWay, ConcurrentVersionsAreIsolated) {
+  // readers keep querying consistent versions while a writer extends a chain
+  // one batch at a time
+  ConcurrentShortestPathCalculator uut;
+  const auto first = uut.add_vertex();
+  uut.publish();
+
+  constexpr std::size_t kBatches = 50;
+  std::atomic<bool> writing{true};
+  std::atomic<std::size_t> failures{0};
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; ++r) {
+    readers.emplace_back([&] {
+      ShortestPathCalculator::QueryWorkspace workspace;
+      do {
+        const auto version = uut.current();
+        const auto vertex_count = version->vertex_count();
+        // every batch takes one id for its vertex and one for its edge, so
+        // the chain in this version ends 2 * batches - 1 ids after first
+        const auto last = vertex_count == 1 ? first : first + 2 * (vertex_count - 1) - 1;
+        const auto [nodes, edges] = version->shortest_path(first, last, workspace);
+        if (nodes.size() != vertex_count || edges.size() + 1 != vertex_count) ++failures;
+      } while (writing);
+    });
+  }
+  // this one goes through the hazard-pointer path of the query methods, so
+  // versions are replaced and freed while it reads them
+  readers.emplace_back([&] {
+    ShortestPathCalculator::QueryWorkspace workspace;
+    std::vector<std::size_t> nodes, edges;
+    do {
+      if (uut.try_shortest_path(first, first, nodes, edges, workspace) != ShortestPathCalculator::PathStatus::found ||
+          nodes.size() != 1) {
+        ++failures;
+      }
+    } while (writing);
+  });
+
+  auto tail = first;
+  for (std::size_t batch = 0; batch < kBatches; ++batch) {
+    uut.update([&tail](ShortestPathCalculator& graph) {
+      const auto next = graph.add_vertex();
+      graph.add_edge(tail, next, 1);
+      tail = next;
+    });
+  }
+  writing = false;
+  for (auto& reader : readers) reader.join();
+
+  EXPECT_EQ(failures.load(), 0);
+  EXPECT_EQ(uut.version_count(), kBatches + 2);
+  const auto [nodes, edges] = uut.shortest_path(first, tail);
+  EXPECT_EQ(nodes.size(), kBatches + 1);
+
+  // staged changes stay invisible until they are published
+  const auto staged = uut.add_vertex();
+  EXPECT_THROW(uut.shortest_path(first, staged), std::runtime_error);
+  uut.add_edge(tail, staged, 1);
+  uut.publish();
+  EXPECT_EQ(std::get<0>(uut.shortest_path(first, staged)).size(), kBatches + 2);
+
+  // a replaced version nobody holds or reads is freed
+  std::weak_ptr<const ShortestPathCalculator::Snapshot> replaced = uut.current();
+  uut.publish();
+  EXPECT_TRUE(replaced.expired());
+}
+
+TEST(BoundedMpmcQueueTest, KeepsEveryItem) {
+  BoundedMpmcQueue<std::unique_ptr<int>> full_queue(3);
+  ASSERT_EQ(full_queue.capacity(), 4);
+  for (int i = 0; i < 4; ++i) {
+    auto item = std::make_unique<int>(i);
+    ASSERT_TRUE(full_queue.try_push(item));
+    EXPECT_FALSE(item);
+  }
+  auto spare = std::make_unique<int>(4);
+  EXPECT_FALSE(full_queue.try_push(spare));
+  EXPECT_TRUE(spare); // A failed push leaves the item with the caller
+  std::unique_ptr<int> popped;
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(full_queue.try_pop(popped));
+    EXPECT_EQ(*popped, i);
+  }
+  EXPECT_FALSE(full_queue.try_pop(popped));
+
+  // several producers and consumers through a small queue: every item comes
+  // out exactly once
+  BoundedMpmcQueue<std::size_t> queue(16);
+  constexpr std::size_t kProducers = 3, kItems = 20000;
+  std::vector<std::atomic<int>> seen(kProducers * kItems);
+  std::atomic<std::size_t> consumed{0};
+  std::vector<std::thread> threads;
+  for (std::size_t p = 0; p < kProducers; ++p) {
+    threads.emplace_back([&, p] {
+      for (std::size_t i = 0; i < kItems; ++i) {
+        auto item = p * kItems + i;
+        while (!queue.try_push(item)) std::this_thread::yield();
+      }
+    });
+  }
+  for (int c = 0; c < 3; ++c) {
+    threads.emplace_back([&] {
+      std::size_t item = 0;
+      while (consumed.load() < kProducers * kItems) {
+        if (queue.try_pop(item)) {
+          ++seen[item];
+          ++consumed;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  for (const auto& count : seen) ASSERT_EQ(count.load(), 1);
+}
+
+TEST(LifeFindsAWay, ServiceAnswersConcurrentClients) {
+  // clients hammer a small service with random queries, a few sources shared
+  // so that batching kicks in; every answer matches a direct query
+  IdVector vertices;
+  const auto graph = std::make_shared<const ShortestPathCalculator::Snapshot>(
+      make_benchmark_grid(12, 20, vertices).snapshot());
+  ShortestPathService service(graph, 3, 8, 16);
+  ASSERT_EQ(service.worker_count(), 3);
+
+  constexpr std::size_t kClients = 4, kQueries = 300;
+  std::atomic<std::size_t> failures{0};
+  std::vector<std::thread> clients;
+  for (std::size_t c = 0; c < kClients; ++c) {
+    clients.emplace_back([&, c] {
+      std::mt19937 rng(static_cast<unsigned>(c));
+      std::uniform_int_distribution<std::size_t> pick(0, vertices.size() - 1);
+      std::vector<std::pair<std::size_t, std::size_t>> queries;
+      std::vector<std::future<ShortestPathService::Path>> results;
+      for (std::size_t q = 0; q < kQueries; ++q) {
+        queries.emplace_back(vertices[pick(rng) % 4], vertices[pick(rng)]);
+        const auto [src, dest] = queries.back();
+        // half the clients shed load first; a refused request is not counted
+        auto accepted = c % 2 == 0 ? service.try_submit(src, dest) : std::nullopt;
+        results.push_back(accepted ? std::move(*accepted) : service.submit(src, dest));
+      }
+      ShortestPathCalculator::QueryWorkspace workspace;
+      for (std::size_t q = 0; q < kQueries; ++q) {
+        const auto [src, dest] = queries[q];
+        try {
+          const auto path = results[q].get();
+          if (path != graph->shortest_path(src, dest, workspace)) ++failures;
+        } catch (const std::runtime_error&) {
+          // the isolated vertex is the only unreachable destination
+          if (dest != vertices.back()) ++failures;
+        }
+      }
+    });
+  }
+  for (auto& client : clients) client.join();
+  EXPECT_EQ(failures.load(), 0);
+  EXPECT_EQ(service.handled(), kClients * kQueries);
+  EXPECT_LE(service.searches(), service.handled());
+
+  // errors travel through the future like shortest_path() throws them
+  const auto unknown = vertices.back() + 1000;
+  auto invalid = service.submit(vertices[0], unknown);
+  EXPECT_THROW(invalid.get(), std::runtime_error);
+  auto unreachable = service.submit(vertices[0], vertices.back());
+  EXPECT_THROW(unreachable.get(), std::runtime_error);
+  EXPECT_EQ(std::get<0>(service.submit(vertices[0], vertices[0]).get()), IdVector{vertices[0]});
+}
+
+template <typename Queue>
+class QueuePolicies : public ComplexGraph {};
+
+using QueueImplementations =
+    ::testing::Types<ShortestPathCalculator::BinaryHeapQueue, ShortestPathCalculator::DaryHeapQueue<2>,
+                     ShortestPathCalculator::DaryHeapQueue<4>, ShortestPathCalculator::DialQueue,
+                     ShortestPathCalculator::RadixHeapQueue>;
+
+TYPED_TEST_SUITE(QueuePolicies, QueueImplementations);
+
+TYPED_TEST(QueuePolicies, SameResultsAsDefaultQueue) {
+  // every queue policy finds the same paths in both search modes
+  using SearchMode = ShortestPathCalculator::SearchMode;
+  auto& uut = this->uut;
+  ShortestPathCalculator::BasicQueryWorkspace<TypeParam> workspace;
+  const auto vertices = IdVector{this->v1, this->v2, this->v3, this->v4, this->v5, this->v6, this->v7, this->v8};
+  auto dijkstra = [&](auto src, auto dst) { return uut.shortest_path(src, dst); };
+  this->expect_same_answers(dijkstra, [&](auto src, auto dst) { return uut.shortest_path(src, dst, workspace); });
+  this->expect_same_answers(dijkstra, [&](auto src, auto dst) {
+    return uut.shortest_path(src, dst, workspace, SearchMode::bidirectional);
+  });
+  const auto table = uut.template distance_table<TypeParam>(vertices, vertices);
+  EXPECT_EQ(table.costs, uut.distance_table(vertices, vertices).costs);
+}
+
+TEST(LifeFindsAWay, DialQueueRejectsHugeCosts) {
+  // a bucket per possible cost would not fit in memory
+  ShortestPathCalculator uut;
+  auto id1 = uut.add_vertex();
+  auto id2 = uut.add_vertex();
+  uut.add_edge(id1, id2, ShortestPathCalculator::DialQueue::kMaxBuckets);
+  ShortestPathCalculator::BasicQueryWorkspace<ShortestPathCalculator::DialQueue> workspace;
+  ASSERT_THROW(uut.shortest_path(id1, id2, workspace), std::length_error);
+}
+
+template <typename Calculator>
+class CompactTypes : public ::testing::Test {};
+
+using CalculatorTypes =
+    ::testing::Types<BasicShortestPathCalculator<std::uint32_t, std::uint32_t>,
+                     BasicShortestPathCalculator<std::uint32_t, float>,
+                     BasicShortestPathCalculator<std::uint64_t, double>,
+                     BasicShortestPathCalculator<std::uint32_t, std::int32_t>>;
+
+TYPED_TEST_SUITE(CompactTypes, CalculatorTypes);
+
+TYPED_TEST(CompactTypes, SameResultsAsDefaultTypes) {
+  // the complex graph built with other id and cost types gives the same
+  // answers through every query engine
+  using Calculator = TypeParam;
+  using Id = typename Calculator::id_type;
+  using Path = std::tuple<std::vector<Id>, std::vector<Id>>;
+  Calculator uut;
+  const auto v = uut.add_vertices(8);
+  const auto e = uut.add_edges({{v[0], v[1], 1}, {v[0], v[2], 1}, {v[1], v[2], 1}, {v[1], v[3], 10},
+                                {v[2], v[3], 5}, {v[2], v[5], 3}, {v[3], v[4], 2}, {v[4], v[5], 11},
+                                {v[5], v[3], 1}, {v[6], v[7], 1}, {v[7], v[6], 1}});
+  const auto expected = Path{{v[0], v[2], v[5], v[3], v[4]}, {e[1], e[5], e[8], e[6]}};
+
+  EXPECT_EQ(uut.shortest_path(v[0], v[4]), expected);
+  EXPECT_EQ(uut.shortest_path(v[0], v[4], Calculator::SearchMode::bidirectional), expected);
+  EXPECT_EQ(uut.shortest_path(v[0], v[4], uut.make_landmarks(2)), expected);
+  EXPECT_EQ(uut.contraction_hierarchy().shortest_path(v[0], v[4]), expected);
+  EXPECT_EQ(uut.shortest_distance(v[0], v[4]), std::optional<typename Calculator::cost_type>(7));
+  EXPECT_FALSE(uut.shortest_distance(v[0], v[7]).has_value());
+  EXPECT_EQ(uut.shortest_path_tree(v[0]).path(v[4]), expected);
+  EXPECT_EQ(uut.distance_table({v[0]}, {v[4], v[7]}).costs,
+            (std::vector<typename Calculator::cost_type>{7, Calculator::kUnreachable}));
+  EXPECT_EQ(uut.cached_shortest_path(v[0], v[4]), expected);
+
+  const auto path = ::testing::TempDir() + "compact_graph.bin";
+  uut.snapshot().save(path);
+  EXPECT_EQ(Calculator::Snapshot::load(path).shortest_path(v[0], v[4]), expected);
+  EXPECT_THROW(ShortestPathCalculator::Snapshot::load(path), std::runtime_error);
+  std::remove(path.c_str());
+
+  if (std::is_signed<typename Calculator::cost_type>::value) {
+    EXPECT_THROW(uut.add_edge(v[0], v[1], -1), std::runtime_error);
+  }
+}
+
+TEST(LifeFindsAWay, IntegerCostsSaturate) {
+  // a sum that does not fit the cost type reads as unreachable instead of
+  // wrapping around to a cheap-looking detour
+  BasicShortestPathCalculator<std::uint32_t, std::uint8_t> uut;
+  const auto a = uut.add_vertex();
+  const auto b = uut.add_vertex();
+  const auto c = uut.add_vertex();
+  const auto d = uut.add_vertex();
+  const auto ab = uut.add_edge(a, b, 200);
+  const auto bc = uut.add_edge(b, c, 200);
+  const auto ac = uut.add_edge(a, c, 250);
+  uut.add_edge(c, d, 10);
+
+  auto [nodes, edges] = uut.shortest_path(a, c);
+  EXPECT_EQ(edges, (std::vector<std::uint32_t>{ac}));
+  EXPECT_EQ(uut.shortest_distance(a, c), std::optional<std::uint8_t>(250));
+  EXPECT_FALSE(uut.shortest_distance(a, d).has_value());
+
+  uut.remove_edge(ac);
+  EXPECT_FALSE(uut.shortest_distance(a, c).has_value());
+  std::tie(nodes, edges) = uut.shortest_path(b, c);
+  EXPECT_EQ(edges, (std::vector<std::uint32_t>{bc}));
+  EXPECT_NE(ab, bc);
+}
+
+TEST(LifeFindsAWay, FloatingPointCosts) {
+  // metric distances are used as they are; negative, infinite and NaN costs
+  // are rejected
+  BasicShortestPathCalculator<std::uint32_t, float> uut;
+  const auto a = uut.add_vertex();
+  const auto b = uut.add_vertex();
+  const auto c = uut.add_vertex();
+  uut.add_edge(a, b, 0.25f);
+  uut.add_edge(b, c, 0.5f);
+  const auto ac = uut.add_edge(a, c, 1.0f);
+  EXPECT_EQ(uut.shortest_distance(a, c), std::optional<float>(0.75f));
+  EXPECT_EQ(uut.shortest_path_tree(a, 0.1f).distance(c), 0.75f);
+
+  uut.update_edge_cost(ac, 0.5f);
+  EXPECT_EQ(uut.shortest_distance(a, c), std::optional<float>(0.5f));
+  EXPECT_THROW(uut.add_edge(a, c, -0.5f), std::runtime_error);
+  EXPECT_THROW(uut.update_edge_cost(ac, std::numeric_limits<float>::infinity()), std::runtime_error);
+  EXPECT_THROW(uut.add_edge(a, c, std::numeric_limits<float>::quiet_NaN()), std::runtime_error);
+}
+
+// Cost of a grid path, after checking that every step moves to a free
+// 8-neighbour without cutting a corner, along an edge that leaves the cell
+// before it and costs what a step in that direction does.
+double checked_grid_path_cost(const OccupancyGrid& grid, const std::vector<OccupancyGrid::id_type>& nodes,
+                              const std::vector<OccupancyGrid::id_type>& edges) {
+  EXPECT_EQ(nodes.size(), edges.size() + 1);
+  double cost = 0;
+  for (std::size_t i = 0; i < edges.size() && i + 1 < nodes.size(); ++i) {
+    const auto [x, y] = grid.cell_of(nodes[i]);
+    const auto [next_x, next_y] = grid.cell_of(nodes[i + 1]);
+    const auto dx = next_x > x ? next_x - x : x - next_x;
+    const auto dy = next_y > y ? next_y - y : y - next_y;
+    EXPECT_TRUE(dx <= 1 && dy <= 1 && dx + dy > 0) << "step " << i << " is not to a neighbour";
+    EXPECT_FALSE(grid.blocked(x, y) || grid.blocked(next_x, y) || grid.blocked(x, next_y) ||
+                 grid.blocked(next_x, next_y))
+        << "step " << i << " crosses a blocked cell";
+    EXPECT_EQ(edges[i] / 8, nodes[i]);
+    EXPECT_DOUBLE_EQ(grid.edge_cost(edges[i]), grid.octile_distance(nodes[i], nodes[i + 1]));
+    cost += grid.edge_cost(edges[i]);
+  }
+  return cost;
+}
+
+TEST(LifeFindsAWay, OccupancyGridMatchesExplicitGraph) {
+  // the implicit grid, with and without jump points, agrees with the same
+  // grid built edge by edge; rows and columns span more than one bit word
+  constexpr std::ptrdiff_t kWidth = 130, kHeight = 50;
+  OccupancyGrid grid(kWidth, kHeight);
+  std::mt19937 rng(7);
+  std::bernoulli_distribution wall(0.3);
+  for (std::ptrdiff_t y = 0; y < kHeight; ++y) {
+    for (std::ptrdiff_t x = 0; x < kWidth; ++x) {
+      if (wall(rng)) grid.set_blocked(x, y);
+    }
+  }
+
+  using Explicit = BasicShortestPathCalculator<std::uint32_t, double>;
+  Explicit graph;
+  const auto cells = graph.add_vertices(kWidth * kHeight);
+  const auto diagonal = grid.octile_distance(grid.cell_id(0, 0), grid.cell_id(1, 1));
+  auto open = [&grid](std::ptrdiff_t x, std::ptrdiff_t y) {
+    return x >= 0 && y >= 0 && x < kWidth && y < kHeight && !grid.blocked(x, y);
+  };
+  std::vector<Explicit::EdgeSpec> edges;
+  for (std::ptrdiff_t y = 0; y < kHeight; ++y) {
+    for (std::ptrdiff_t x = 0; x < kWidth; ++x) {
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          if ((dx != 0 || dy != 0) && open(x, y) && open(x + dx, y + dy) && open(x + dx, y) && open(x, y + dy)) {
+            edges.push_back({cells[y * kWidth + x], cells[(y + dy) * kWidth + x + dx], dx && dy ? diagonal : 1.0});
+          }
+        }
+      }
+    }
+  }
+  graph.add_edges(edges);
+
+  std::uniform_int_distribution<OccupancyGrid::id_type> cell(0, kWidth * kHeight - 1);
+  OccupancyGrid::QueryWorkspace workspace;
+  for (int round = 0; round < 100; ++round) {
+    const auto src = cell(rng);
+    const auto dest = cell(rng);
+    const auto expected = graph.shortest_distance(cells[src], cells[dest]);
+    ASSERT_EQ(grid.shortest_distance(src, dest, workspace).has_value(), expected.has_value());
+    if (!expected) {
+      EXPECT_THROW(grid.jump_point_path(src, dest, workspace), std::runtime_error);
+      continue;
+    }
+    EXPECT_NEAR(*grid.shortest_distance(src, dest, workspace, OccupancyGrid::SearchMode::bidirectional),
+                *expected, 1e-9);
+
+    const auto [nodes, edge_ids] = grid.jump_point_path(src, dest, workspace);
+    ASSERT_FALSE(nodes.empty());
+    EXPECT_EQ(nodes.front(), src);
+    EXPECT_EQ(nodes.back(), dest);
+    EXPECT_NEAR(checked_grid_path_cost(grid, nodes, edge_ids), *expected, 1e-9);
+
+    const auto [guided_nodes, guided_edges] = grid.shortest_path(
+        src, dest, workspace, [&grid, dest](OccupancyGrid::id_type v) { return grid.octile_distance(v, dest); });
+    EXPECT_NEAR(checked_grid_path_cost(grid, guided_nodes, guided_edges), *expected, 1e-9);
+  }
+}
+
+TEST(LifeFindsAWay, OccupancyGridJumpPointSearch) {
+  // . . # . .
+  // . . # . .
+  // . . . . .
+  OccupancyGrid grid(5, 3);
+  grid.set_blocked(2, 0);
+  grid.set_blocked(2, 1);
+  const auto sqrt2 = grid.octile_distance(grid.cell_id(0, 0), grid.cell_id(1, 1));
+
+  // (2, 2) can only be entered and left straight, the diagonals would cut
+  // the corner of the wall
+  auto [nodes, edges] = grid.jump_point_path(grid.cell_id(0, 0), grid.cell_id(4, 0));
+  EXPECT_NEAR(checked_grid_path_cost(grid, nodes, edges), 4 + 2 * sqrt2, 1e-12);
+  EXPECT_EQ(nodes.size(), 7);
+  EXPECT_NE(std::find(nodes.begin(), nodes.end(), grid.cell_id(2, 2)), nodes.end());
+
+  // on an open grid many paths tie; jump points may pick another one than
+  // Dijkstra, but it must be just as short and a real path
+  OccupancyGrid open(8, 8);
+  for (const auto dest : {open.cell_id(7, 3), open.cell_id(5, 7), open.cell_id(7, 7), open.cell_id(0, 6)}) {
+    const auto src = open.cell_id(0, 0);
+    const auto [tied_nodes, tied_edges] = open.jump_point_path(src, dest);
+    ASSERT_FALSE(tied_nodes.empty());
+    EXPECT_EQ(tied_nodes.front(), src);
+    EXPECT_EQ(tied_nodes.back(), dest);
+    EXPECT_NEAR(checked_grid_path_cost(open, tied_nodes, tied_edges), *open.shortest_distance(src, dest), 1e-12);
+  }
+
+  std::tie(nodes, edges) = grid.jump_point_path(grid.cell_id(3, 0), grid.cell_id(3, 0));
+  EXPECT_EQ(nodes, (std::vector<OccupancyGrid::id_type>{grid.cell_id(3, 0)}));
+  EXPECT_TRUE(edges.empty());
+
+  grid.set_blocked(2, 2);
+  EXPECT_THROW(grid.jump_point_path(grid.cell_id(0, 0), grid.cell_id(4, 0)), std::runtime_error);
+  EXPECT_FALSE(grid.shortest_distance(grid.cell_id(0, 0), grid.cell_id(4, 0)).has_value());
+  EXPECT_THROW(grid.jump_point_path(grid.cell_id(0, 0), 15), std::runtime_error);
+  EXPECT_THROW(grid.set_blocked(5, 0), std::out_of_range);
+}
+
+// Benchmarks follow. They are disabled to keep the regular test run fast; run
+// them with --gtest_also_run_disabled_tests --gtest_filter='*Benchmark*'.
+
+TYPED_TEST(QueuePolicies, DISABLED_BenchmarkSettledThroughput) {
+  // compares the queue policies
+  for (const ShortestPathCalculator::cost_type max_cost : {10, 1000, 1000000}) {
+    IdVector vertices;
+    const auto graph = make_benchmark_grid(300, max_cost, vertices);
+    const auto snapshot = graph.snapshot();
+    const auto isolated = vertices.back();
+    ShortestPathCalculator::BasicQueryWorkspace<TypeParam> workspace;
+
+    constexpr std::size_t kQueries = 20;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t query = 0; query < kQueries; ++query) {
+      EXPECT_THROW(snapshot.shortest_path(vertices[query * 997 % (vertices.size() - 1)], isolated, workspace),
+                   std::runtime_error);
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const auto settled = static_cast<double>(kQueries * (vertices.size() - 1));
+    std::cout << "max cost " << max_cost << ": " << settled / elapsed.count() / 1e6 << " M settled vertices/s"
+              << std::endl;
+  }
+}
+
+TEST(LifeFindsAWay, DISABLED_BenchmarkShortestPathTree) {
+  // compares worker counts
+  IdVector vertices;
+  const auto snapshot = make_benchmark_grid(1000, 1000, vertices).snapshot();
+  const auto workers = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  for (std::size_t thread_count = 1; thread_count <= workers; thread_count *= 2) {
+    ThreadPool pool(thread_count);
+    const auto start = std::chrono::steady_clock::now();
+    const auto tree = snapshot.shortest_path_tree(vertices[vertices.size() / 2], pool);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(tree.distance(vertices.back()), ShortestPathCalculator::kUnreachable);
+    std::cout << thread_count << " workers: " << elapsed.count() * 1e3 << " ms" << std::endl;
+  }
+}
+
+TEST(LifeFindsAWay, DISABLED_BenchmarkBulkConstruction) {
+  // compares add_edge() with add_edges()
+  constexpr std::size_t kSide = 1000;
+  IdVector vertices;
+  auto start = std::chrono::steady_clock::now();
+  make_benchmark_grid(kSide, 1000, vertices);
+  const std::chrono::duration<double> single = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  ShortestPathCalculator graph;
+  graph.reserve(kSide * kSide, 4 * kSide * kSide);
+  vertices = graph.add_vertices(kSide * kSide);
+  std::vector<ShortestPathCalculator::EdgeSpec> edges;
+  edges.reserve(4 * kSide * kSide);
+  for (std::size_t y = 0; y < kSide; ++y) {
+    for (std::size_t x = 0; x < kSide; ++x) {
+      const auto here = vertices[y * kSide + x];
+      if (x + 1 < kSide) {
+        edges.push_back({here, vertices[y * kSide + x + 1], 1 + (x + y) % 1000});
+        edges.push_back({vertices[y * kSide + x + 1], here, 1 + (x * y) % 1000});
+      }
+      if (y + 1 < kSide) {
+        edges.push_back({here, vertices[(y + 1) * kSide + x], 1 + (x + 2 * y) % 1000});
+        edges.push_back({vertices[(y + 1) * kSide + x], here, 1 + (2 * x + y) % 1000});
+      }
+    }
+  }
+  graph.add_edges(edges);
+  const std::chrono::duration<double> bulk = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(graph.snapshot().edge_count(), 4 * kSide * (kSide - 1));
+  std::cout << "add_edge: " << single.count() * 1e3 << " ms, add_edges: " << bulk.count() * 1e3 << " ms"
+            << std::endl;
+}
+
+TEST(LifeFindsAWay, DISABLED_BenchmarkColdStart) {
+  // compares building the graph edge by edge with mapping a saved copy
+  const auto path = ::testing::TempDir() + "benchmark_graph.bin";
+  IdVector vertices;
+  auto start = std::chrono::steady_clock::now();
+  const auto graph = make_benchmark_grid(1000, 1000, vertices);
+  const std::chrono::duration<double> built = std::chrono::steady_clock::now() - start;
+  graph.snapshot().save(path);
+
+  start = std::chrono::steady_clock::now();
+  const auto loaded = ShortestPathCalculator::Snapshot::load(path);
+  const std::chrono::duration<double> mapped = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(loaded.vertex_count(), vertices.size());
+  EXPECT_TRUE(loaded.shortest_distance(vertices.front(), vertices[vertices.size() - 2]).has_value());
+  std::cout << "build: " << built.count() * 1e3 << " ms, load: " << mapped.count() * 1e3 << " ms" << std::endl;
+  std::remove(path.c_str());
+}
+
+TEST(LifeFindsAWay, DISABLED_BenchmarkOccupancyGrid) {
+  // compares Dijkstra, A* and Jump Point Search on a large grid with
+  // scattered obstacles
+  constexpr std::size_t kSide = 2000;
+  OccupancyGrid grid(kSide, kSide);
+  std::mt19937 rng(99);
+  std::bernoulli_distribution wall(0.2);
+  for (std::size_t y = 0; y < kSide; ++y) {
+    for (std::size_t x = 0; x < kSide; ++x) {
+      if (wall(rng)) grid.set_blocked(x, y);
+    }
+  }
+  const auto src = grid.cell_id(0, 0);
+  const auto dest = grid.cell_id(kSide - 1, kSide - 1);
+  grid.set_blocked(0, 0, false);
+  grid.set_blocked(kSide - 1, kSide - 1, false);
+  OccupancyGrid::QueryWorkspace workspace;
+
+  auto time = [](auto&& query) {
+    const auto start = std::chrono::steady_clock::now();
+    query();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() * 1e3;
+  };
+  const auto dijkstra = time([&] { grid.shortest_path(src, dest, workspace); });
+  const auto guided = time([&] {
+    grid.shortest_path(src, dest, workspace, [&grid, dest](OccupancyGrid::id_type v) {
+      return grid.octile_distance(v, dest);
+    });
+  });
+  const auto jump_points = time([&] { grid.jump_point_path(src, dest, workspace); });
+  std::cout << "grid " << kSide * kSide / 4 / 1024 << " KiB, dijkstra: " << dijkstra << " ms, A*: " << guided
+            << " ms, jump points: " << jump_points << " ms" << std::endl;
+}
+
+TEST(LifeFindsAWay, DISABLED_BenchmarkNearestTargets) {
+  // compares one query per candidate with a single nearest_targets() search
+  IdVector vertices;
+  const auto snapshot = make_benchmark_grid(500, 100, vertices).snapshot();
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<std::size_t> pick(0, vertices.size() - 2);
+  IdVector stations;
+  for (int i = 0; i < 50; ++i) stations.push_back(vertices[pick(rng)]);
+  const auto src = vertices[vertices.size() / 2];
+  ShortestPathCalculator::QueryWorkspace workspace;
+
+  auto start = std::chrono::steady_clock::now();
+  auto best = ShortestPathCalculator::kUnreachable;
+  for (const auto station : stations) best = std::min(best, *snapshot.shortest_distance(src, station, workspace));
+  const std::chrono::duration<double> one_by_one = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  const auto nearest = snapshot.nearest_targets(src, stations, 1, workspace);
+  const std::chrono::duration<double> single = std::chrono::steady_clock::now() - start;
+  ASSERT_EQ(nearest.size(), 1);
+  EXPECT_EQ(nearest[0].cost, best);
+  std::cout << "50 queries: " << one_by_one.count() * 1e3 << " ms, nearest_targets: " << single.count() * 1e3
+            << " ms" << std::endl;
+}
+
+TEST(LifeFindsAWay, DISABLED_BenchmarkQueryService) {
+  // shows throughput and tail latency as workers are added; two clients per
+  // worker keep the queue busy
+  IdVector vertices;
+  const auto graph = std::make_shared<const ShortestPathCalculator::Snapshot>(
+      make_benchmark_grid(200, 100, vertices).snapshot());
+  constexpr std::size_t kQueriesPerClient = 400;
+  const auto max_workers = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  for (std::size_t workers = 1; workers <= max_workers; workers *= 2) {
+    ShortestPathService service(graph, workers);
+    const auto client_count = 2 * workers;
+    std::vector<std::vector<double>> latencies(client_count);
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (std::size_t c = 0; c < client_count; ++c) {
+      clients.emplace_back([&, c] {
+        std::mt19937 rng(static_cast<unsigned>(c));
+        // a few hundred popular sources, as with robots leaving from docks
+        std::uniform_int_distribution<std::size_t> dock(0, 255), pick(0, vertices.size() - 2);
+        for (std::size_t q = 0; q < kQueriesPerClient; ++q) {
+          const auto sent = std::chrono::steady_clock::now();
+          service.submit(vertices[dock(rng) * 97 % (vertices.size() - 1)], vertices[pick(rng)]).get();
+          latencies[c].push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+        }
+      });
+    }
+    for (auto& client : clients) client.join();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<double> all;
+    for (const auto& client : latencies) all.insert(all.end(), client.begin(), client.end());
+    std::sort(all.begin(), all.end());
+    std::cout << workers << " workers: " << all.size() / elapsed.count() << " queries/s, p50 "
+              << all[all.size() / 2] << " ms, p99 " << all[all.size() * 99 / 100] << " ms, "
+              << service.searches() << " searches for " << service.handled() << " queries" << std::endl;
+  }
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();